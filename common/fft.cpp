@@ -0,0 +1,58 @@
+#include "fft.h"
+#include <cmath>
+#include <map>
+#include <mutex>
+
+size_t next_pow2(size_t n)
+{
+    size_t p = 1;
+    while (p < n)
+        p <<= 1;
+    return p;
+}
+
+const std::vector<dcomplex> &fft_twiddles(size_t n)
+{
+    static std::mutex mtx;
+    static std::map<size_t, std::vector<dcomplex>> cache;
+
+    std::lock_guard<std::mutex> lock(mtx);
+    std::vector<dcomplex> &w = cache[n];
+    if (w.empty()) {
+        w.resize(n / 2);
+        for (size_t i = 0; i < n / 2; i++)
+            w[i] = std::polar(1.0, -2.0 * M_PI * i / n);
+    }
+    return w;
+}
+
+void fft_radix2(dcomplex *x, size_t n, bool inverse)
+{
+    if (n <= 1)
+        return;
+
+    for (size_t i = 1, j = 0; i < n; i++) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j)
+            std::swap(x[i], x[j]);
+    }
+
+    const std::vector<dcomplex> &twiddle = fft_twiddles(n);
+    double sign = inverse ? -1.0 : 1.0;
+    for (size_t len = 2; len <= n; len <<= 1) {
+        size_t half = len / 2, step = n / len;
+        for (size_t first = 0; first < n; first += len) {
+            dcomplex *lo = x + first, *hi = lo + half;
+            for (size_t i = 0; i < half; i++) {
+                // Spelled out: operator* on complex goes through the NaN-safe library call.
+                double wr = twiddle[i * step].real(), wi = sign * twiddle[i * step].imag();
+                dcomplex t(wr * hi[i].real() - wi * hi[i].imag(), wr * hi[i].imag() + wi * hi[i].real());
+                hi[i] = lo[i] - t;
+                lo[i] += t;
+            }
+        }
+    }
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+typedef std::complex<double> dcomplex;
+
+// Smallest power of two >= n.
+size_t next_pow2(size_t n);
+
+// exp(-2 pi i k / n) for k < n / 2, computed once per size; safe to call
+// from several threads.
+const std::vector<dcomplex> &fft_twiddles(size_t n);
+
+// In-place iterative radix-2 FFT of n (a power of two) values. The inverse
+// transform is not scaled by 1/n.
+void fft_radix2(dcomplex *x, size_t n, bool inverse = false);
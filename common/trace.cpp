@@ -0,0 +1,182 @@
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+
+namespace trace
+{
+std::atomic<bool> enabled(false);
+
+struct span {
+    std::string name;
+    uint64_t start;
+    uint64_t end;
+};
+struct counter_event {
+    const char *name;
+    uint64_t time;
+    int64_t delta;
+};
+struct thread_buffer {
+    uint tid;
+    bool in_use = false;
+    std::vector<span> spans;
+    std::vector<counter_event> counts;
+};
+
+static std::mutex registry_mtx;
+static std::vector<std::unique_ptr<thread_buffer>> registry;
+
+// Claims a free buffer for the calling thread and returns it when the thread
+// exits, so the threads of the next load reuse it instead of adding more.
+struct buffer_owner {
+    thread_buffer *buf = nullptr;
+    buffer_owner()
+    {
+        std::lock_guard<std::mutex> lock(registry_mtx);
+        for (auto &b : registry)
+            if (!b->in_use)
+                buf = b.get();
+        if (!buf) {
+            registry.push_back(std::make_unique<thread_buffer>());
+            buf = registry.back().get();
+            buf->tid = registry.size();
+        }
+        buf->in_use = true;
+    }
+    ~buffer_owner()
+    {
+        std::lock_guard<std::mutex> lock(registry_mtx);
+        buf->in_use = false;
+    }
+};
+
+static thread_buffer &local()
+{
+    thread_local buffer_owner owner;
+    return *owner.buf;
+}
+
+uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void record(const std::string &name, uint64_t start_ns, uint64_t end_ns)
+{
+    local().spans.push_back({ name, start_ns, end_ns });
+}
+
+void add(const char *counter, int64_t delta)
+{
+    local().counts.push_back({ counter, now_ns(), delta });
+}
+
+void clear()
+{
+    std::lock_guard<std::mutex> lock(registry_mtx);
+    for (auto &b : registry) {
+        b->spans.clear();
+        b->counts.clear();
+    }
+}
+
+std::vector<stage> stages()
+{
+    std::map<std::string, stage> by_name;
+    {
+        std::lock_guard<std::mutex> lock(registry_mtx);
+        for (auto &b : registry) {
+            for (auto &s : b->spans) {
+                stage &st = by_name.emplace(s.name, stage{ s.name, 0, 0.0, 0.0 }).first->second;
+                double ms = (s.end - s.start) * 1e-6;
+                st.calls++;
+                st.total_ms += ms;
+                st.max_ms = std::max(st.max_ms, ms);
+            }
+        }
+    }
+
+    std::vector<stage> out;
+    for (auto &kv : by_name)
+        out.push_back(kv.second);
+    std::sort(out.begin(), out.end(), [](const stage &a, const stage &b) { return a.total_ms > b.total_ms; });
+    return out;
+}
+
+std::vector<total> counters()
+{
+    std::map<std::string, int64_t> sums;
+    {
+        std::lock_guard<std::mutex> lock(registry_mtx);
+        for (auto &b : registry)
+            for (auto &c : b->counts)
+                sums[c.name] += c.delta;
+    }
+
+    std::vector<total> out;
+    for (auto &kv : sums)
+        out.push_back({ kv.first, kv.second });
+    return out;
+}
+
+static std::string escape(const std::string &s)
+{
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+bool write_chrome(const std::string &path)
+{
+    FILE *f = fopen(path.c_str(), "w");
+    if (!f)
+        return false;
+
+    std::lock_guard<std::mutex> lock(registry_mtx);
+    uint64_t origin = UINT64_MAX;
+    std::vector<std::pair<uint, counter_event>> counts;
+    for (auto &b : registry) {
+        for (auto &s : b->spans)
+            origin = std::min(origin, s.start);
+        for (auto &c : b->counts) {
+            origin = std::min(origin, c.time);
+            counts.push_back({ b->tid, c });
+        }
+    }
+
+    // Spans become complete ("X") events; counters become running totals ("C").
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    const char *sep = "";
+    for (auto &b : registry) {
+        for (auto &s : b->spans) {
+            fprintf(f, "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}", sep,
+                    escape(s.name).c_str(), b->tid, (s.start - origin) * 1e-3, (s.end - s.start) * 1e-3);
+            sep = ",\n";
+        }
+    }
+    std::sort(counts.begin(), counts.end(),
+              [](const std::pair<uint, counter_event> &a, const std::pair<uint, counter_event> &b) {
+                  return a.second.time < b.second.time;
+              });
+    std::map<std::string, int64_t> running;
+    for (auto &c : counts) {
+        int64_t &v = running[c.second.name];
+        v += c.second.delta;
+        fprintf(f, "%s{\"name\": \"%s\", \"ph\": \"C\", \"pid\": 1, \"ts\": %.3f, \"args\": {\"value\": %lld}}", sep,
+                escape(c.second.name).c_str(), (c.second.time - origin) * 1e-3, static_cast<long long>(v));
+        sep = ",\n";
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    return true;
+}
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+typedef unsigned int uint;
+
+// Scoped timers and counters for the load and update paths, shared by both
+// analyzers. Nothing is recorded until `enabled` is set; a disabled scope or
+// counter costs one relaxed atomic load. Every thread appends to its own
+// buffer, so recording takes no lock.
+namespace trace
+{
+extern std::atomic<bool> enabled;
+
+inline bool on() { return enabled.load(std::memory_order_relaxed); }
+uint64_t now_ns();
+void record(const std::string &name, uint64_t start_ns, uint64_t end_ns);
+void add(const char *counter, int64_t delta);
+
+// Times the enclosing block. The label is only assembled when tracing is on,
+// so a disabled scope allocates nothing.
+class scope
+{
+public:
+    // name (usually a literal) must outlive the scope.
+    scope(const char *name) : scope(name, nullptr) {}
+    // Recorded as "prefix detail", e.g. ("analyze", channel name).
+    scope(const char *prefix, const std::string &detail) : scope(prefix, &detail) {}
+    // Recorded under make(), which only runs when tracing is on.
+    template <typename F, typename = std::enable_if_t<std::is_invocable_r_v<std::string, F>>>
+    scope(F make)
+    {
+        if (on()) {
+            text = make();
+            start = now_ns();
+            active = true;
+        }
+    }
+    ~scope()
+    {
+        if (!active)
+            return;
+        uint64_t end = now_ns();
+        if (prefix)
+            record(detail ? std::string(prefix) + " " + *detail : std::string(prefix), start, end);
+        else
+            record(text, start, end);
+    }
+    scope(const scope &) = delete;
+    scope &operator = (const scope &) = delete;
+
+private:
+    const char *prefix = nullptr;
+    const std::string *detail = nullptr;
+    std::string text;
+    uint64_t start = 0;
+    bool active = false;
+
+    scope(const char *p, const std::string *d)
+    {
+        if (on()) {
+            prefix = p;
+            detail = d;
+            start = now_ns();
+            active = true;
+        }
+    }
+};
+
+// Adds delta to a running total such as frames processed or bytes touched.
+inline void count(const char *counter, int64_t delta)
+{
+    if (on())
+        add(counter, delta);
+}
+
+// Drops everything recorded so far, e.g. when a new file starts loading.
+// No other thread may be recording at the time.
+void clear();
+
+struct stage {
+    std::string name;
+    uint calls;
+    double total_ms;
+    double max_ms;
+};
+struct total {
+    std::string name;
+    int64_t value;
+};
+// Recorded scopes summed per name, slowest first, and the counter totals.
+std::vector<stage> stages();
+std::vector<total> counters();
+
+// Everything recorded as Chrome/Perfetto trace JSON (chrome://tracing, ui.perfetto.dev).
+bool write_chrome(const std::string &path);
+}
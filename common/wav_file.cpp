@@ -0,0 +1,243 @@
+#include "wav_file.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static uint32_t le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static uint16_t le16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+wav_file::~wav_file()
+{
+    close();
+}
+
+bool wav_file::fail(const std::string &msg)
+{
+    close();
+    err = msg;
+    return false;
+}
+
+bool wav_file::open(const std::string &path, access_pattern access)
+{
+    close();
+    err.clear();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return fail("cannot open " + path);
+
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    file_size = static_cast<size_t>(size.QuadPart);
+    mapping = file_size ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+    CloseHandle(file);
+    if (!mapping)
+        return fail("cannot map " + path);
+
+    base = static_cast<uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!base)
+        return fail("cannot map " + path);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return fail("cannot open " + path);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return fail("cannot stat " + path);
+    }
+
+    file_size = static_cast<size_t>(st.st_size);
+    void *map = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+        return fail("cannot map " + path);
+
+    base = static_cast<uint8_t *>(map);
+    madvise(map, file_size, access == access_random ? MADV_RANDOM : MADV_SEQUENTIAL);
+#endif
+
+    return parse();
+}
+
+void wav_file::close()
+{
+    if (base) {
+#ifdef _WIN32
+        UnmapViewOfFile(base);
+#else
+        munmap(base, file_size);
+#endif
+    }
+#ifdef _WIN32
+    if (mapping)
+        CloseHandle(mapping);
+    mapping = nullptr;
+#endif
+    base = nullptr;
+    data = nullptr;
+    file_size = 0;
+    frames = 0;
+    channels = 0;
+}
+
+bool wav_file::parse()
+{
+    if (file_size < 12 || memcmp(base, "RIFF", 4) || memcmp(base + 8, "WAVE", 4))
+        return fail("not a RIFF/WAVE file");
+
+    bool have_fmt = false;
+    size_t pos = 12;
+    while (pos + 8 <= file_size) {
+        const uint8_t *chunk = base + pos;
+        size_t size = le32(chunk + 4);
+        size_t avail = file_size - pos - 8;
+
+        if (!memcmp(chunk, "fmt ", 4)) {
+            if (size < 16 || size > avail)
+                return fail("truncated fmt chunk");
+
+            uint tag = le16(chunk + 8);
+            channels = le16(chunk + 10);
+            rate = le32(chunk + 12);
+            block_align = le16(chunk + 20);
+            bits = le16(chunk + 22);
+            if (tag == 0xFFFE && size >= 40)
+                tag = le16(chunk + 32);
+
+            if (tag != format_int && tag != format_float)
+                return fail("unsupported WAV format tag " + std::to_string(tag));
+            fmt = static_cast<sample_format>(tag);
+
+            bool bits_ok = (fmt == format_int) ?
+                (bits == 8 || bits == 16 || bits == 24 || bits == 32) :
+                (bits == 32 || bits == 64);
+            if (!bits_ok || channels == 0 || rate == 0 || block_align != channels * bits / 8)
+                return fail("inconsistent fmt chunk");
+            have_fmt = true;
+        } else if (!memcmp(chunk, "data", 4)) {
+            if (!have_fmt)
+                return fail("data chunk before fmt chunk");
+
+            // Streaming writers leave the size at 0 or 0xFFFFFFFF, so clamp to the file.
+            size = std::min(size ? size : avail, avail);
+            data = chunk + 8;
+            frames = size / block_align;
+            return true;
+        }
+
+        pos += 8 + size + (size & 1);
+    }
+
+    return fail(have_fmt ? "missing data chunk" : "missing fmt chunk");
+}
+
+template <>
+bool wav_file::holds<int16_t>() const
+{
+    return is_open() && fmt == format_int && bits == 16 &&
+        reinterpret_cast<uintptr_t>(data) % alignof(int16_t) == 0;
+}
+
+template <>
+bool wav_file::holds<float>() const
+{
+    return is_open() && fmt == format_float && bits == 32 &&
+        reinterpret_cast<uintptr_t>(data) % alignof(float) == 0;
+}
+
+template <>
+bool wav_file::holds<double>() const
+{
+    return is_open() && fmt == format_float && bits == 64 &&
+        reinterpret_cast<uintptr_t>(data) % alignof(double) == 0;
+}
+
+template <typename T>
+static inline T from_int(int32_t v, uint bits)
+{
+    return static_cast<T>(v / static_cast<double>(1u << (bits - 1)));
+}
+
+template <>
+inline int16_t from_int<int16_t>(int32_t v, uint bits)
+{
+    return static_cast<int16_t>(bits >= 16 ? v >> (bits - 16) : v << (16 - bits));
+}
+
+template <typename T>
+static inline T from_float(double v)
+{
+    return static_cast<T>(v);
+}
+
+template <>
+inline int16_t from_float<int16_t>(double v)
+{
+    return static_cast<int16_t>(lround(std::max(-1.0, std::min(1.0, v)) * 32767.0));
+}
+
+template <typename T>
+void wav_file::read(uint c, size_t first, size_t n, T *out) const
+{
+    n = std::min(n, first < frames ? frames - first : 0);
+    const uint8_t *p = data + first * block_align + c * (bits / 8);
+
+    if (fmt == format_float) {
+        for (size_t i = 0; i < n; i++, p += block_align) {
+            if (bits == 32) {
+                float v;
+                memcpy(&v, p, sizeof(v));
+                out[i] = from_float<T>(v);
+            } else {
+                double v;
+                memcpy(&v, p, sizeof(v));
+                out[i] = from_float<T>(v);
+            }
+        }
+        return;
+    }
+
+    switch (bits) {
+    case 8:
+        for (size_t i = 0; i < n; i++, p += block_align)
+            out[i] = from_int<T>(static_cast<int32_t>(p[0]) - 128, 8);
+        break;
+    case 16:
+        for (size_t i = 0; i < n; i++, p += block_align)
+            out[i] = from_int<T>(static_cast<int16_t>(le16(p)), 16);
+        break;
+    case 24:
+        for (size_t i = 0; i < n; i++, p += block_align)
+            out[i] = from_int<T>(static_cast<int32_t>((p[0] << 8) | (p[1] << 16) |
+                               (static_cast<uint32_t>(p[2]) << 24)) >> 8, 24);
+        break;
+    default:
+        for (size_t i = 0; i < n; i++, p += block_align)
+            out[i] = from_int<T>(static_cast<int32_t>(le32(p)), 32);
+        break;
+    }
+}
+
+template void wav_file::read(uint c, size_t first, size_t n, double *out) const;
+template void wav_file::read(uint c, size_t first, size_t n, float *out) const;
+template void wav_file::read(uint c, size_t first, size_t n, int16_t *out) const;
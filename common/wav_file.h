@@ -0,0 +1,89 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+typedef unsigned int uint;
+
+// Non-owning view of one channel, either contiguous or interleaved with
+// the other channels of a frame (stride > 1).
+template <typename T>
+struct pcm_view
+{
+    const T *data = nullptr;
+    size_t frames = 0;
+    uint stride = 1;
+
+    pcm_view() {}
+    pcm_view(const T *d, size_t n, uint s = 1) : data(d), frames(n), stride(s) {}
+    pcm_view(const std::vector<T> &v) : data(v.data()), frames(v.size()), stride(1) {}
+    const T &operator [] (size_t i) const { return data[i * stride]; }
+    size_t size() const { return frames; }
+};
+
+// Memory-mapped WAV reader. open() only parses the RIFF/fmt/data headers,
+// samples are paged in when they are first touched.
+class wav_file
+{
+public:
+    enum sample_format { format_int = 1, format_float = 3 };
+
+    wav_file() {}
+    wav_file(const wav_file &) = delete;
+    wav_file &operator = (const wav_file &) = delete;
+    ~wav_file();
+
+    // How the samples will be touched, as a paging hint: front to back while
+    // analysing a whole file, or wherever a view goes.
+    enum access_pattern { access_sequential, access_random };
+
+    bool open(const std::string &path, access_pattern access = access_sequential);
+    void close();
+    bool is_open() const { return base != nullptr; }
+    const std::string &error() const { return err; }
+
+    uint num_channels() const { return channels; }
+    uint sample_rate() const { return rate; }
+    uint bit_depth() const { return bits; }
+    sample_format format() const { return fmt; }
+    size_t num_frames() const { return frames; }
+    double length_seconds() const { return static_cast<double>(frames) / rate; }
+    const uint8_t *payload() const { return data; }
+
+    // True when the payload can be viewed as T without conversion.
+    template <typename T>
+    bool holds() const;
+
+    // Zero-copy view of channel c, only valid when holds<T>().
+    template <typename T>
+    pcm_view<T> channel(uint c) const
+    {
+        return pcm_view<T>(reinterpret_cast<const T *>(data) + c, frames, channels);
+    }
+
+    // De-interleaves and converts n frames of channel c starting at first.
+    template <typename T>
+    void read(uint c, size_t first, size_t n, T *out) const;
+
+private:
+    bool fail(const std::string &msg);
+    bool parse();
+
+    uint8_t *base = nullptr;
+    size_t file_size = 0;
+    const uint8_t *data = nullptr;
+    size_t frames = 0;
+    uint channels = 0;
+    uint rate = 0;
+    uint bits = 0;
+    uint block_align = 0;
+    sample_format fmt = format_int;
+    std::string err;
+#ifdef _WIN32
+    void *mapping = nullptr;
+#endif
+};
+
+template <> bool wav_file::holds<int16_t>() const;
+template <> bool wav_file::holds<float>() const;
+template <> bool wav_file::holds<double>() const;
@@ -1,122 +1,589 @@
 #include "audio.h"
+#include "ring_buffer.h"
+#include "trace.h"
 #include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
-void audio::init(std::string filename)
+void parallel_for(uint n, const std::function<void(uint)> &fn, uint max_workers)
 {
-    af.load(filename);
-    tv.resize(af.getNumSamplesPerChannel());
-    double period = af.getLengthInSeconds() / static_cast<double>(tv.size() - 1);
-    for (uint i = 0; i < tv.size(); i++) {
-        tv[i] = period * static_cast<double>(i);
+    uint workers = std::min(n, max_workers ? max_workers : std::max(1u, std::thread::hardware_concurrency()));
+    std::atomic<uint> next(0);
+    auto work = [&]() {
+        for (uint i = next++; i < n; i = next++)
+            fn(i);
+    };
+
+    std::vector<std::thread> pool;
+    for (uint w = 1; w < workers; w++)
+        pool.emplace_back(work);
+    work();
+    for (auto &t : pool)
+        t.join();
+}
+
+template <typename T>
+void basic_audio<T>::init(std::string filename, analysis_options opts)
+{
+    unload();
+    this->filename = filename;
+    this->opts = opts;
+    err.clear();
+    trace::scope load("load");
+
+    bool pipelined = opts.pipelined && !opts.mid_side && !opts.downmix;
+    if (wav.open(filename)) {
+        fs = wav.sample_rate();
+        length = wav.length_seconds();
+        if (wav.holds<T>()) {
+            for (uint c = 0; c < wav.num_channels(); c++)
+                chans.push_back(wav.channel<T>(c));
+        } else {
+            trace::scope decode("decode");
+            decoded.resize(wav.num_channels());
+            for (uint c = 0; c < wav.num_channels(); c++) {
+                decoded[c].resize(wav.num_frames());
+                trace::count("allocations", 1);
+                if (!pipelined) {
+                    wav.read(c, 0, wav.num_frames(), decoded[c].data());
+                    trace::count("bytes decoded", wav.num_frames() * sizeof(T));
+                }
+                chans.push_back(decoded[c]);
+            }
+        }
+    } else {
+        err = wav.error();
+        if (!af.load(filename)) {
+            err += "; AudioFile cannot read it either";
+            return;
+        }
+        fs = static_cast<double>(af.getNumSamplesPerChannel()) / af.getLengthInSeconds();
+        length = af.getLengthInSeconds();
+        for (auto &ch : af.samples)
+            chans.push_back(ch);
+    }
+
+    if (num_samples() < 2)
+        return;
+
+    for (uint c = 0; c < chans.size(); c++) {
+        channels.emplace_back();
+        channels.back().name = chans.size() == 2 ? (c ? "right" : "left") : "ch " + std::to_string(c);
+    }
+    filter = fir_filter(opts.filter, fs);
+    if (pipelined) {
+        add_filter(false);
+        run_pipeline();
+    } else {
+        add_mixes(opts);
+        add_filter(true);
+        parallel_for(channels.size(), [this](uint c) {
+            trace::scope t("analyze", channels[c].name);
+            analyze(channels[c], chans[c]);
+        }, opts.workers);
+    }
+
+    loaded = true;
+}
+
+// Mid/side and downmix are built in one sweep over the interleaved frames.
+template <typename T>
+void basic_audio<T>::add_mixes(analysis_options opts)
+{
+    uint nc = chans.size();
+    bool mid_side = opts.mid_side && nc == 2;
+    bool downmix = opts.downmix && nc > 1;
+    if (!mid_side && !downmix)
+        return;
+
+    size_t ns = num_samples();
+    std::vector<T> mid, side, down;
+    if (mid_side) {
+        mid.resize(ns);
+        side.resize(ns);
+    }
+    if (downmix)
+        down.resize(ns);
+
+    // int16 sums are exact in int64 and the averages always fit back into int16.
+    typedef typename std::conditional<std::is_integral<T>::value, int64_t, double>::type sum_t;
+    for (size_t i = 0; i < ns; i++) {
+        sum_t sum = 0;
+        for (uint c = 0; c < nc; c++)
+            sum += chans[c][i];
+        if (mid_side) {
+            mid[i] = static_cast<T>(sum / 2);
+            side[i] = static_cast<T>((static_cast<sum_t>(chans[0][i]) - chans[1][i]) / 2);
+        }
+        if (downmix)
+            down[i] = static_cast<T>(sum / static_cast<sum_t>(nc));
     }
-    ffs.clear();
-    tps.clear();
-    ffs.resize(5);
-    ffs[0] = std::make_unique<volume_fun>();
-    ffs[1] = std::make_unique<ste_fun>();
-    ffs[2] = std::make_unique<zcr_fun>(af);
-    ffs[3] = std::make_unique<ff_fun>(af);
-    ffs[4] = std::make_unique<sr_fun>(af);
 
+    auto add = [this](std::string name, std::vector<T> &samples) {
+        derived.push_back(std::move(samples));
+        chans.push_back(derived.back());
+        channels.emplace_back();
+        channels.back().name = name;
+    };
+    derived.reserve(3);
+    if (mid_side) {
+        add("mid", mid);
+        add("side", side);
+    }
+    if (downmix)
+        add("downmix", down);
+}
+
+// The filtered signal replaces the input for every feature; the pipeline
+// fills it chunk by chunk, otherwise it is filtered here in parallel pieces.
+template <typename T>
+void basic_audio<T>::add_filter(bool fill)
+{
+    if (filter.empty())
+        return;
+
+    size_t ns = num_samples();
+    unfiltered = chans;
+    filtered.resize(chans.size());
+    for (uint c = 0; c < chans.size(); c++) {
+        filtered[c].resize(ns);
+        chans[c] = filtered[c];
+    }
+    trace::count("allocations", chans.size());
+    if (!fill)
+        return;
+
+    trace::scope t("filter");
+    const size_t piece = 1 << 16;
+    size_t pieces = (ns + piece - 1) / piece;
+    parallel_for(chans.size() * pieces, [&](uint k) {
+        uint c = k % chans.size();
+        size_t first = (k / chans.size()) * piece;
+        filter.process(unfiltered[c], first, std::min(ns, first + piece), filtered[c].data());
+    }, opts.workers);
+}
+
+template <typename T>
+void basic_audio<T>::analyze(channel &ch, pcm_view<T> src, bool compute)
+{
+    auto &ffs = ch.ffs;
+    ffs.resize(6);
+    ffs[0] = std::make_unique<volume_fun<T>>();
+    ffs[1] = std::make_unique<ste_fun<T>>();
+    ffs[2] = std::make_unique<zcr_fun<T>>(fs);
+    uint factor = opts.pitch_decimation ? opts.pitch_decimation : pitch_decimation(fs);
+    ffs[3] = std::make_unique<ff_fun<T>>(fs, &decimated, factor);
+    ffs[4] = std::make_unique<yin_fun<T>>(fs);
+    ffs[5] = std::make_unique<sr_fun<T>>(fs);
+
+    // Each series is a node carrying its frame grid. Gated features measure the
+    // volume of their own frames and the silence ratio is built from volume and ZCR.
+    feature_graph &g = ch.graph;
+    auto add_series = [&g](const std::string &name, time_params *tp, const std::vector<uint> &inputs,
+                           std::function<void()> compute) {
+        uint id = g.size();
+        return g.add(name, inputs, [&g, id, tp, compute]() {
+            tp->frame_size = g.param(id, "frame_size");
+            tp->overlap = g.param(id, "overlap");
+            compute();
+        }, { { "frame_size", tp->frame_size }, { "overlap", tp->overlap } });
+    };
+
+    std::map<std::string, uint> ids;
+    time_params *vol = nullptr;
+    time_params *zcr = nullptr;
     for (auto &ff : ffs) {
-        tps.emplace(ff->get_name(), time_params(af, *ff));
+        std::string name = ff->get_name();
+        bool gated = opts.gate_silence && ff->gated();
+        time_params *tp = &ch.tps.emplace(name, time_params(src, length, *ff, 1200, 20, gated,
+                                                             false)).first->second;
+        std::vector<uint> inputs;
+        std::function<void()> compute = [tp]() { tp->recalc(); };
+        if (ff.get() == ffs[5].get()) {
+            inputs = { ids.at(ffs[0]->get_name()), ids.at(ffs[2]->get_name()) };
+            // The adaptive threshold needs the whole volume series, which is
+            // complete by the time this node runs.
+            sr_fun<T> *sr = static_cast<sr_fun<T> *>(ff.get());
+            bool adaptive = opts.adaptive_silence;
+            compute = [tp, vol, zcr, sr, adaptive]() {
+                sr->threshold = adaptive ? adaptive_silence_volume(vol->stats) : silence_volume;
+                double threshold = sr->threshold;
+                tp->combine(*vol, *zcr, [threshold](double v, double z) { return v < threshold ? (z > 50 ? 0.5 : 1) : 0; });
+            };
+        }
+        ids[name] = add_series(name, tp, inputs, compute);
+        if (ff.get() == ffs[0].get())
+            vol = tp;
+        if (ff.get() == ffs[2].get())
+            zcr = tp;
     }
 
-    scalars.clear();
-    scalar_vals.clear();
-    scalars.resize(6);
+    // Entropy reads STE at two scales that are not shown as features.
+    time_params *ste_short = &ch.aux.emplace("STE 100", time_params(src, length, *ffs[1], 100, 0, false,
+                                                                    false)).first->second;
+    time_params *ste_long = &ch.aux.emplace("STE 1200", time_params(src, length, *ffs[1], 1200, 0, false,
+                                                                    false)).first->second;
+    ids["STE 100"] = add_series("STE 100", ste_short, {}, [ste_short]() { ste_short->recalc(); });
+    ids["STE 1200"] = add_series("STE 1200", ste_long, {}, [ste_long]() { ste_long->recalc(); });
+
+    auto &scalars = ch.scalars;
+    scalars.resize(7);
     scalars[0] = { ffs[0]->get_name(), std::make_unique<deviation_norm_fun>() };
     scalars[1] = { ffs[0]->get_name(), std::make_unique<dynamic_range_func>() };
     scalars[2] = { ffs[1]->get_name(), std::make_unique<low_ratio_fun>() };
     scalars[3] = { ffs[2]->get_name(), std::make_unique<deviation_fun>() };
     scalars[4] = { ffs[2]->get_name(), std::make_unique<high_ratio_fun>() };
-    scalars[5] = { ffs[1]->get_name(), std::make_unique<entropy_func>(af) };
+    scalars[5] = { ffs[0]->get_name(), std::make_unique<percentile_range_fun>() };
+    scalars[6] = { ffs[3]->get_name(), std::make_unique<median_fun>() };
 
-    for (auto &sf : scalars) {
-        scalar_vals.emplace(sf.second->get_name() + " (" + sf.first + "): ",
-            (*(sf.second))(tps.find(sf.first)->second.vals.begin(),
-            tps.find(sf.first)->second.vals.end()));
+    for (uint i = 0; i < scalars.size(); i++) {
+        std::string name = scalars[i].second->get_name() + " (" + scalars[i].first + "): ";
+        double *out = &ch.scalar_vals[name];
+        scalar_func *sf = scalars[i].second.get();
+        const running_stats *stats = &ch.tps.find(scalars[i].first)->second.stats;
+        g.add(name, { ids.at(scalars[i].first) }, [out, sf, stats]() { *out = (*sf)(*stats); });
     }
 
-    loaded = true;
+    // Entropy is not a summary of one series but reads STE at both scales.
+    std::string entropy_name = "entropy (" + ffs[1]->get_name() + "): ";
+    double *entropy = &ch.scalar_vals[entropy_name];
+    g.add(entropy_name, { ids["STE 100"], ids["STE 1200"] }, [entropy, ste_short, ste_long]() {
+        *entropy = ste_entropy(ste_short->vals, ste_short->frame_size - ste_short->overlap,
+                               ste_long->vals, ste_long->frame_size - ste_long->overlap);
+    });
+
+    if (compute)
+        g.update();
+}
+
+// Loading as four stages joined by bounded SPSC queues: a reader decodes (or
+// pages in) the file a chunk at a time and decimates it for the pitch search,
+// a framer hands out every (channel, frame) whose samples are ready, one worker
+// per core computes all feature series of a frame, and the sink stores the
+// results in frame order. A full queue puts the stage feeding it to sleep,
+// an empty one the stage reading it.
+template <typename T>
+void basic_audio<T>::run_pipeline()
+{
+    uint nc = channels.size();
+    for (uint c = 0; c < nc; c++)
+        analyze(channels[c], chans[c], false);
+
+    // Frame series of each channel in ffs order, so volume comes first and can
+    // gate the rest. The silence ratio (last) is combined from volume and ZCR,
+    // and sequential features need their frames in order; both are left to
+    // the graph afterwards.
+    static constexpr uint max_series = 8;
+    std::vector<uint> framed;
+    for (uint j = 0; j + 1 < channels[0].ffs.size(); j++)
+        if (!channels[0].ffs[j]->sequential())
+            framed.push_back(j);
+    uint n_series = framed.size();
+    if (n_series > max_series) {
+        parallel_for(nc, [this](uint c) { channels[c].graph.update(); }, opts.workers);
+        return;
+    }
+    std::vector<std::vector<time_params *>> series(nc);
+    for (uint c = 0; c < nc; c++)
+        for (uint j : framed)
+            series[c].push_back(&channels[c].tps.at(channels[c].ffs[j]->get_name()));
+    uint nf = 0;
+    for (auto &s : series)
+        for (time_params *tp : s)
+            nf = tp->reset();
+    uint stride = series[0][0]->frame_size - series[0][0]->overlap;
+    uint frame_size = series[0][0]->frame_size;
+    size_t ns = num_samples();
+
+    // The filter and the decimation for the pitch search run alongside the
+    // samples; the decimator reads filtered samples.
+    uint factor = opts.pitch_decimation ? opts.pitch_decimation : pitch_decimation(fs);
+    const decimator &dm = decimator::shared(factor);
+    std::vector<T *> dec(nc, nullptr);
+    if (factor > 1)
+        for (uint c = 0; c < nc; c++)
+            dec[c] = decimated.reserve(chans[c], factor).data();
+    size_t lookahead = factor > 1 ? dm.lookahead() : 0;
+
+    // Samples [0, ready) and everything decimated from them can be read.
+    std::atomic<size_t> ready(0);
+    std::mutex ready_mtx;
+    std::condition_variable ready_cv;
+    std::thread reader([&]() {
+        const size_t chunk = 1 << 16;
+        size_t filt_done = 0;
+        size_t dec_done = 0;
+        volatile double touched = 0.0;
+        for (size_t first = 0; first < ns; first += chunk) {
+            trace::scope read("read chunk");
+            size_t end = std::min(ns, first + chunk);
+            if (!decoded.empty()) {
+                for (uint c = 0; c < nc; c++)
+                    wav.read(c, first, end - first, decoded[c].data() + first);
+                trace::count("bytes decoded", (end - first) * nc * sizeof(T));
+            } else if (wav.holds<T>()) {
+                // Fault the mapped pages in here rather than in the workers.
+                for (size_t i = first; i < end; i += 512)
+                    touched = touched + wav.channel<T>(0)[i];
+            }
+
+            // Filtered samples [0, avail) are final.
+            size_t avail = end;
+            if (!filter.empty()) {
+                trace::scope t("filter");
+                size_t filt_end = end == ns ? ns : (end > filter.lookahead() ? end - filter.lookahead() : 0);
+                parallel_for(nc, [&](uint c) {
+                    filter.process(unfiltered[c], filt_done, filt_end, filtered[c].data());
+                }, opts.workers);
+                filt_done = std::max(filt_done, filt_end);
+                avail = filt_done;
+            }
+
+            size_t safe = avail == ns ? ns : (avail > lookahead ? avail - lookahead : 0);
+            if (factor > 1) {
+                size_t dec_end = avail == ns ? (ns + factor - 1) / factor : safe / factor;
+                for (uint c = 0; c < nc; c++)
+                    dm.process(chans[c], dec_done, dec_end, dec[c]);
+                dec_done = std::max(dec_done, dec_end);
+            }
+            {
+                std::lock_guard<std::mutex> lock(ready_mtx);
+                ready.store(safe, std::memory_order_release);
+            }
+            ready_cv.notify_all();
+        }
+    });
+
+    struct frame_task {
+        uint channel;
+        uint frame;
+        double vals[max_series];
+    };
+    uint workers = opts.workers ? opts.workers : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::unique_ptr<ring_buffer<frame_task>>> tasks, results;
+    for (uint w = 0; w < workers; w++) {
+        tasks.push_back(std::make_unique<ring_buffer<frame_task>>(64));
+        results.push_back(std::make_unique<ring_buffer<frame_task>>(64));
+    }
+    size_t total = static_cast<size_t>(nf) * nc;
+
+    // Tasks go to the workers round-robin, so reading the results in the same
+    // order gives them back in frame order.
+    std::thread framer([&]() {
+        size_t k = 0;
+        for (uint i = 0; i < nf; i++) {
+            size_t need = std::min<size_t>(ns, static_cast<size_t>(i) * stride + frame_size);
+            if (ready.load(std::memory_order_acquire) < need) {
+                std::unique_lock<std::mutex> lock(ready_mtx);
+                ready_cv.wait(lock, [&]() { return ready.load(std::memory_order_acquire) >= need; });
+            }
+            for (uint c = 0; c < nc; c++, k++) {
+                frame_task t;
+                t.channel = c;
+                t.frame = i;
+                tasks[k % workers]->push_wait(&t, 1);
+            }
+        }
+    });
+
+    std::vector<std::thread> pool;
+    for (uint w = 0; w < workers; w++) {
+        pool.emplace_back([&, w]() {
+            trace::scope work("feature worker");
+            for (size_t k = w; k < total; k += workers) {
+                frame_task t;
+                tasks[w]->pop_wait(&t, 1);
+                const std::vector<time_params *> &s = series[t.channel];
+                for (uint j = 0; j < n_series; j++) {
+                    time_params *tp = s[j];
+                    if (tp->gate && t.vals[0] < silence_volume)
+                        t.vals[j] = NAN;
+                    else
+                        t.vals[j] = tp->fun(tp->track, t.frame * stride, frame_size);
+                }
+                results[w]->push_wait(&t, 1);
+            }
+        });
+    }
+
+    trace::count("frames", total * n_series);
+    trace::count("bytes touched", total * n_series * frame_size * sizeof(T));
+    {
+        trace::scope drain("sink");
+        for (size_t k = 0; k < total; k++) {
+            frame_task t;
+            results[k % workers]->pop_wait(&t, 1);
+            const std::vector<time_params *> &s = series[t.channel];
+            for (uint j = 0; j < n_series; j++) {
+                time_params *tp = s[j];
+                tp->vals[t.frame] = t.vals[j];
+                tp->stats.add(t.vals[j]);
+                if (tp->gate && std::isnan(t.vals[j]))
+                    tp->gated_frames++;
+            }
+        }
+    }
+
+    reader.join();
+    framer.join();
+    for (auto &t : pool)
+        t.join();
+
+    // The remaining nodes (silence ratio, sequential features, the STE scales
+    // behind entropy and the scalars) run as usual.
+    parallel_for(nc, [&](uint c) {
+        trace::scope t("graph", channels[c].name);
+        feature_graph &g = channels[c].graph;
+        for (uint j : framed)
+            g.mark_done(g.find(channels[c].ffs[j]->get_name()));
+        g.update();
+    }, opts.workers);
+}
+
+template <typename T>
+uint basic_audio<T>::set_frame(uint c, const std::string &feature, uint frame_size, uint overlap)
+{
+    feature_graph &g = channels[c].graph;
+    int id = g.find(feature);
+    if (id < 0 || frame_size < 2 || overlap >= frame_size)
+        return 0;
+
+    trace::scope t("set_frame", feature);
+    g.set_param(id, "frame_size", frame_size);
+    g.set_param(id, "overlap", overlap);
+    return g.update();
 }
 
-audio::~audio()
+template <typename T>
+void basic_audio<T>::unload()
 {
+    channels.clear();
+    decimated.clear();
+    chans.clear();
+    filtered.clear();
+    unfiltered.clear();
+    filter = fir_filter();
+    derived.clear();
+    decoded.clear();
+    wav.close();
+    af = AudioFile<T>();
+    loaded = false;
 }
 
-std::vector<double> &audio::get_time_vec()
+template <typename T>
+basic_audio<T>::~basic_audio()
 {
-    return tv;
 }
 
-std::vector<double> &audio::get_main_vec()
+template <typename T>
+pcm_view<T> basic_audio<T>::get_view(uint c)
 {
-    return af.samples[0];
+    return chans[c];
 }
 
-bool audio::is_loaded()
+template <typename T>
+size_t basic_audio<T>::sample_bytes()
+{
+    size_t bytes = 0;
+    for (auto &ch : decoded)
+        bytes += ch.size() * sizeof(T);
+    for (auto &ch : derived)
+        bytes += ch.size() * sizeof(T);
+    for (auto &ch : filtered)
+        bytes += ch.size() * sizeof(T);
+    bytes += decimated.bytes();
+    for (auto &ch : af.samples)
+        bytes += ch.size() * sizeof(T);
+    return bytes;
+}
+
+template <typename T>
+bool basic_audio<T>::is_loaded()
 {
     return loaded;
 }
 
-double volume_fun::operator () (std::vector<double> main_ts, uint offset, uint frame_size)
+static inline bool is_negative(double v) { return signbit(v); }
+static inline bool is_negative(float v) { return signbit(v); }
+static inline bool is_negative(int16_t v) { return v < 0; }
+
+template <typename T>
+double volume_fun<T>::operator () (pcm_view<T> main_ts, uint offset, uint frame_size)
 {
+    typedef typename sample_traits<T>::acc_t acc_t;
     uint N = 0;
-    double sum = 0;
+    acc_t sum = 0;
     for (uint i = 0; i + offset < main_ts.size() && i < frame_size; i++) {
-        double val = main_ts[offset + i];
+        acc_t val = main_ts[offset + i];
         sum += val * val;
         N++;
     }
 
-    return sqrt(sum / static_cast<double>(N));
+    return sqrt(static_cast<double>(sum) / static_cast<double>(N)) * sample_traits<T>::scale;
 }
 
-double ste_fun::operator () (std::vector<double> main_ts, uint offset, uint frame_size)
+template <typename T>
+double ste_fun<T>::operator () (pcm_view<T> main_ts, uint offset, uint frame_size)
 {
+    typedef typename sample_traits<T>::acc_t acc_t;
     uint N = 0;
-    double sum = 0;
+    acc_t sum = 0;
     for (uint i = 0; i + offset < main_ts.size() && i < frame_size; i++) {
-        double val = main_ts[offset + i];
+        acc_t val = main_ts[offset + i];
         sum += val * val;
         N++;
     }
 
-    return sum / static_cast<double>(N);
+    return static_cast<double>(sum) / static_cast<double>(N) *
+        sample_traits<T>::scale * sample_traits<T>::scale;
 }
 
-double zcr_fun::operator () (std::vector<double> main_ts, uint offset, uint frame_size)
+template <typename T>
+double zcr_fun<T>::operator () (pcm_view<T> main_ts, uint offset, uint frame_size)
 {
     uint sum = 0;
     uint N = 1;
     for (uint i = 0; i + offset + 1 < main_ts.size() && i + 1 < frame_size; i++) {
-        sum += static_cast<uint>(((uint)signbit(main_ts[offset + i]) !=
-                                  (uint)signbit(main_ts[offset + i + 1])));
+        sum += static_cast<uint>(is_negative(main_ts[offset + i]) !=
+                                 is_negative(main_ts[offset + i + 1]));
         N++;
     }
 
     return static_cast<double>(sum) * sampling_rate / static_cast<double>(N);
 }
-double sr_fun::operator () (std::vector<double> main_ts, uint offset, uint frame_size)
+
+template <typename T>
+double sr_fun<T>::operator () (pcm_view<T> main_ts, uint offset, uint frame_size)
 {
     double volume = vf(main_ts, offset, frame_size);
     double zcr = zf(main_ts, offset, frame_size);
 
-    if (volume < 0.02)
+    if (volume < threshold)
         return zcr > 50 ? 0.5 : 1;
     return 0;
 }
 
-double ff_fun::operator () (std::vector<double> main_ts, uint offset, uint frame_size)
+template <typename T>
+static typename sample_traits<T>::acc_t lag_product(pcm_view<T> ts, uint offset, uint n, uint l)
+{
+    typename sample_traits<T>::acc_t rm = 0;
+    for (uint i = 0; i + l < n; i++) {
+        rm += static_cast<typename sample_traits<T>::acc_t>(ts[offset + i]) * ts[offset + i + l];
+    }
+    return rm;
+}
+
+template <typename T>
+static uint best_lag(pcm_view<T> ts, uint offset, uint n, uint min_l, uint max_l)
 {
-    double min_rn = std::numeric_limits<double>::min();
+    typedef typename sample_traits<T>::acc_t acc_t;
+    acc_t min_rn = std::is_integral<acc_t>::value ? 0 : std::numeric_limits<acc_t>::min();
     uint best_l = 0;
-    for (uint l = 40; l < frame_size * 2 / 3; l++) {
-        double rm = 0;
-        for (uint i = 0; i < frame_size - l; i++) {
-            rm += main_ts[offset + i] * main_ts[offset + i + l];
-        }
+    for (uint l = min_l; l < max_l; l++) {
+        acc_t rm = lag_product(ts, offset, n, l);
 
         if (rm > min_rn) {
             min_rn = rm;
@@ -124,112 +591,467 @@ double ff_fun::operator () (std::vector<double> main_ts, uint offset, uint frame
         }
     }
 
-    return sampling_rate / static_cast<double>(best_l);
+    return best_l;
 }
-double amdf_fun::operator () (std::vector<double> main_ts, uint offset, uint frame_size) {return 3;}
 
-static double average(std::vector<double>::iterator start, std::vector<double>::iterator end)
+template <typename T>
+double ff_fun<T>::operator () (pcm_view<T> main_ts, uint offset, uint frame_size)
 {
-    double sum = 0;
-    double N = static_cast<double>(end - start);
-    for (auto it = start; it < end; ++it) {
-        sum += *it;
+    frame_size = std::min<size_t>(frame_size, main_ts.size() - offset);
+    uint max_l = frame_size * 2 / 3;
+    if (!cache || factor <= 1)
+        return sampling_rate / static_cast<double>(best_lag(main_ts, offset, frame_size, 40, max_l));
+
+    // Coarse search on the decimated signal, then refine around it at full rate.
+    const std::vector<T> &dec = cache->get(main_ts, factor);
+    uint d_size = std::min<size_t>(frame_size / factor, dec.size() - offset / factor);
+    uint coarse = best_lag(pcm_view<T>(dec), offset / factor, d_size, (40 + factor - 1) / factor,
+                           d_size * 2 / 3);
+    if (coarse == 0)
+        return sampling_rate / 0.0;
+
+    uint lo = std::max(40u, coarse * factor - factor);
+    uint hi = std::min(max_l, coarse * factor + factor + 1);
+    uint l = best_lag(main_ts, offset, frame_size, lo, hi);
+    if (l == 0)
+        return sampling_rate / 0.0;
+
+    double r0 = lag_product(main_ts, offset, frame_size, l - 1);
+    double r1 = lag_product(main_ts, offset, frame_size, l);
+    double r2 = lag_product(main_ts, offset, frame_size, l + 1);
+    double den = r0 - 2.0 * r1 + r2;
+    double delta = den < 0.0 ? 0.5 * (r0 - r2) / den : 0.0;
+
+    return sampling_rate / (l + std::max(-0.5, std::min(0.5, delta)));
+}
+
+// Squared difference between the first w samples and the w samples l later.
+template <typename T>
+double yin_fun<T>::difference(uint w, uint l) const
+{
+    // Four partial sums so the adds do not wait on each other.
+    double sum[4] = {};
+    const double *a = x.data(), *b = x.data() + l;
+    uint j = 0;
+    for (; j + 4 <= w; j += 4)
+        for (uint k = 0; k < 4; k++)
+            sum[k] += (a[j + k] - b[j + k]) * (a[j + k] - b[j + k]);
+    for (; j < w; j++)
+        sum[0] += (a[j] - b[j]) * (a[j] - b[j]);
+    return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
+
+template <typename T>
+double yin_fun<T>::search(uint w, uint max_l, bool &clear)
+{
+    // x and its first w samples go in as the real and imaginary parts of one
+    // transform; splitting the spectra gives X * conj(W), whose inverse is
+    // acf(l) = sum x[j] x[j + l] over j < w without wrapping.
+    size_t n = next_pow2(w + max_l);
+    buf.assign(n, dcomplex(0.0, 0.0));
+    for (uint i = 0; i < w + max_l; i++)
+        buf[i] = dcomplex(x[i], i < w ? x[i] : 0.0);
+    fft_radix2(buf.data(), n);
+    for (size_t k = 0; k <= n / 2; k++) {
+        size_t j = (n - k) & (n - 1);
+        dcomplex zk = buf[k], zj = std::conj(buf[j]);
+        dcomplex a = 0.5 * (zk + zj);
+        dcomplex b = dcomplex(0.0, -0.5) * (zk - zj);
+        dcomplex p = a * std::conj(b);
+        buf[k] = p;
+        buf[j] = std::conj(p);
     }
+    fft_radix2(buf.data(), n, true);
 
-    return sum / N;
+    // d'(l) = d(l) * l / sum(d(1..l)), d(l) = r(0) + r(l) - 2 acf(l).
+    uint min_l = std::max(2.0, sampling_rate / max_f0);
+    d.assign(max_l + 1, 1.0);
+    double r0 = energy[w];
+    double sum = 0.0;
+    for (uint l = 1; l <= max_l; l++) {
+        double diff = std::max(0.0, r0 + energy[l + w] - energy[l] - 2.0 * buf[l].real() / n);
+        sum += diff;
+        d[l] = sum > 0.0 ? diff * l / sum : 1.0;
+    }
+
+    uint best = 0;
+    for (uint l = min_l; l < max_l; l++) {
+        if (d[l] < threshold) {
+            while (l + 1 < max_l && d[l + 1] < d[l])
+                l++;
+            best = l;
+            break;
+        }
+    }
+    clear = best != 0;
+    if (!clear) {
+        // No clear dip: take the deepest one unless the frame is aperiodic.
+        for (uint l = min_l; l < max_l; l++)
+            if (d[l] < 0.5 && (best == 0 || d[l] < d[best]))
+                best = l;
+        if (best == 0)
+            return 0.0;
+    }
+
+    double den = d[best - 1] - 2.0 * d[best] + d[best + 1];
+    double delta = den > 0.0 ? 0.5 * (d[best - 1] - d[best + 1]) / den : 0.0;
+    return best + std::max(-0.5, std::min(0.5, delta));
 }
 
-double deviation_fun::operator () (std::vector<double>::iterator start, std::vector<double>::iterator end)
+template <typename T>
+double yin_fun<T>::track(uint w, uint max_l, bool &clear)
 {
-    double avg = average(start, end);
-    double N = static_cast<double>(end - start);
-    double dev = 0;
+    uint min_l = std::max(2.0, sampling_rate / max_f0);
+    uint lo = std::max<double>(min_l, floor(prev_period * (1.0 - band)));
+    uint hi = std::min<double>(max_l - 1, ceil(prev_period * (1.0 + band)));
+    if (hi < lo + 4)
+        return 0.0;
 
-    for (auto it = start; it < end; ++it) {
-        dev += pow(*it - avg, 2);
+    // In a narrow band the cumulative mean is close to r(0) + r(l), the value
+    // of d for uncorrelated lags, so the same threshold applies.
+    double r0 = energy[w];
+    uint best = 0;
+    double best_nd = threshold, d_lo = 0.0, d_best = 0.0, d_hi = 0.0, prev_d = 0.0;
+    bool next = false;
+    for (uint l = lo; l <= hi; l++) {
+        double diff = difference(w, l);
+        if (next) {
+            d_hi = diff;
+            next = false;
+        }
+        double norm = r0 + energy[l + w] - energy[l];
+        double nd = norm > 0.0 ? diff / norm : 1.0;
+        if (nd < best_nd) {
+            best_nd = nd;
+            best = l;
+            d_lo = prev_d;
+            d_best = diff;
+            next = true;
+        }
+        prev_d = diff;
+    }
+    // A dip on the band edge is moving out of it; a dip at half the period
+    // means the pitch jumped an octave up. Both need the full search.
+    if (best <= lo || best >= hi)
+        return 0.0;
+    uint half = static_cast<uint>(round(best / 2.0));
+    if (half >= min_l) {
+        for (uint l = half - 1; l <= half + 1; l++) {
+            double norm = r0 + energy[l + w] - energy[l];
+            if (norm > 0.0 && difference(w, l) / norm < threshold)
+                return 0.0;
+        }
     }
 
-    return sqrt(dev / N);
+    clear = true;
+    double den = d_lo - 2.0 * d_best + d_hi;
+    double delta = den > 0.0 ? 0.5 * (d_lo - d_hi) / den : 0.0;
+    return best + std::max(-0.5, std::min(0.5, delta));
 }
 
-double deviation_norm_fun::operator () (std::vector<double>::iterator start, std::vector<double>::iterator end)
+template <typename T>
+double yin_fun<T>::operator () (pcm_view<T> main_ts, uint offset, uint frame_size)
 {
-    double avg = average(start, end);
-    double N = static_cast<double>(end - start);
-    double max_vol = *std::max_element(start, end);
-    double dev = 0;
+    frame_size = std::min<size_t>(frame_size, main_ts.size() - offset);
+    uint max_l = frame_size / 2;
+    uint w = frame_size - max_l;
+    if (max_l < std::max(2.0, sampling_rate / max_f0) + 2) {
+        prev_period = 0.0;
+        return NAN;
+    }
+
+    x.resize(frame_size);
+    energy.resize(frame_size + 1);
+    energy[0] = 0.0;
+    for (uint i = 0; i < frame_size; i++) {
+        x[i] = main_ts[offset + i] * sample_traits<T>::scale;
+        energy[i + 1] = energy[i] + x[i] * x[i];
+    }
 
-    for (auto it = start; it < end; ++it) {
-        dev += pow(*it - avg, 2);
+    bool clear = false;
+    double period = 0.0;
+    bool adjacent = prev_period > 0.0 && static_cast<long>(offset) > prev_offset &&
+        offset - prev_offset <= frame_size;
+    if (tracking && adjacent)
+        period = track(w, max_l, clear);
+    if (period > 0.0) {
+        tracked++;
+    } else {
+        period = search(w, max_l, clear);
+        searched++;
     }
 
-    return sqrt(dev / N) / max_vol;
+    prev_offset = offset;
+    prev_period = clear ? period : 0.0;
+    return period > 0.0 ? sampling_rate / period : NAN;
 }
 
-double dynamic_range_func::operator () (std::vector<double>::iterator start, std::vector<double>::iterator end)
+template <typename T>
+double decimated_fun<T>::operator () (pcm_view<T> main_ts, uint offset, uint frame_size)
 {
-    double max_v = *std::max_element(start, end);
-    double min_v = *std::min_element(start, end);
+    const std::vector<T> &dec = cache.get(main_ts, factor);
+    return (*inner)(dec, offset / factor, std::max(1u, frame_size / factor));
+}
+
+template <typename T>
+double amdf_fun<T>::operator () (pcm_view<T> main_ts, uint offset, uint frame_size) {return 3;}
 
-    return (max_v - min_v) / max_v;
+void running_histogram::add(double v)
+{
+    if (width == 0.0) {
+        // [0, 2v) for a positive first value, [2v, 0) for a negative one.
+        double span = v != 0.0 ? 2.0 * fabs(v) : 1e-9;
+        lo = v < 0.0 ? -span : 0.0;
+        width = span / num_bins;
+    }
+    while (v >= lo + width * num_bins || v < lo) {
+        // Double the range away from the side v is on.
+        bool up = v >= lo;
+        size_t merged[num_bins] = {};
+        for (uint k = 0; k < num_bins; k++)
+            merged[up ? k / 2 : (k + num_bins) / 2] += counts[k];
+        std::copy(merged, merged + num_bins, counts);
+        if (!up)
+            lo -= width * num_bins;
+        width *= 2.0;
+    }
+    counts[std::min(num_bins - 1, static_cast<uint>((v - lo) / width))]++;
+    n++;
 }
 
-double low_ratio_fun::operator () (std::vector<double>::iterator start, std::vector<double>::iterator end)
+double running_histogram::fraction_below(double x) const
 {
-    double avg = average(start, end) * 0.5;
-    uint sum = 0;
-    double N = static_cast<double>(end - start);
+    if (n == 0 || std::isnan(x))
+        return NAN;
+    double f = (x - lo) / width;
+    if (!(f > 0.0))
+        return 0.0;
+    if (f >= num_bins)
+        return 1.0;
+
+    uint b = static_cast<uint>(f);
+    size_t below = 0;
+    for (uint k = 0; k < b; k++)
+        below += counts[k];
+    return (below + counts[b] * (f - b)) / n;
+}
 
-    for (auto it = start; it < end; ++it) {
-        sum += signbit(*it - avg);
+double running_histogram::quantile(double p) const
+{
+    if (n == 0)
+        return NAN;
+    double target = p * n;
+    size_t below = 0;
+    for (uint k = 0; k < num_bins; k++) {
+        if (counts[k] > 0 && below + counts[k] >= target)
+            return lo + width * (k + (target - below) / counts[k]);
+        below += counts[k];
     }
+    return lo + width * num_bins;
+}
+
+void running_stats::add(double v)
+{
+    if (std::isnan(v))
+        return;
+
+    n++;
+    double delta = v - mean;
+    mean += delta / n;
+    m2 += delta * (v - mean);
+    min = std::min(min, v);
+    max = std::max(max, v);
+    if (std::isfinite(v))
+        hist.add(v);
+}
+
+double running_stats::percentile(double p) const
+{
+    // The exact extremes tighten the first and last bin.
+    return std::min(std::max(hist.quantile(p), min), max);
+}
+
+// Digital silence would put a volume floor at 0; -100 dBFS is quiet enough.
+static constexpr double volume_floor = 1e-5;
+
+double adaptive_silence_volume(const running_stats &s)
+{
+    if (s.n == 0)
+        return silence_volume;
+    double floor = std::max(s.percentile(0.1), volume_floor);
+    double loud = std::max(s.percentile(0.9), floor);
+    // Nothing within 20 dB of the loud level is silence, even when the
+    // recording has no quiet passages to put the floor on.
+    return std::min(floor * pow(loud / floor, 0.25), 0.1 * loud);
+}
+
+double deviation_fun::operator () (const running_stats &s)
+{
+    return s.deviation();
+}
+
+double deviation_norm_fun::operator () (const running_stats &s)
+{
+    return s.deviation() / s.max;
+}
 
-    return static_cast<double>(sum) / N;
+double dynamic_range_func::operator () (const running_stats &s)
+{
+    return (s.max - s.min) / s.max;
 }
 
-double entropy_func::operator () (std::vector<double>::iterator start, std::vector<double>::iterator end)
+double low_ratio_fun::operator () (const running_stats &s)
 {
-    ste_fun sf;
-    audio::time_params k_frames(af, sf, 100, 0);
-    audio::time_params n_frames(af, sf, 1200, 0);
+    return s.low_ratio();
+}
 
+double ste_entropy(const std::vector<double> &short_ste, uint short_stride,
+                   const std::vector<double> &long_ste, uint long_stride)
+{
+    trace::scope t("entropy");
     double sum = 0;
-    for (uint i = 0; i < k_frames.vals.size(); i++) {
-        double sigma = k_frames.vals[i] / n_frames.vals[i / 12];
+    for (uint i = 0; i < short_ste.size(); i++) {
+        size_t j = static_cast<size_t>(i) * short_stride / long_stride;
+        if (j >= long_ste.size())
+            break;
+        double sigma = short_ste[i] / long_ste[j];
         sum -= sigma * log2(sigma);
     }
 
     return sum;
 }
 
-double high_ratio_fun::operator () (std::vector<double>::iterator start, std::vector<double>::iterator end)
+double high_ratio_fun::operator () (const running_stats &s)
 {
-    double avg = average(start, end) * 1.5;
-    uint sum = 0;
-    double N = static_cast<double>(end - start);
+    return s.high_ratio();
+}
 
-    for (auto it = start; it < end; ++it) {
-        sum += signbit(avg - *it);
-    }
+double median_fun::operator () (const running_stats &s)
+{
+    return s.percentile(0.5);
+}
 
-    return static_cast<double>(sum) / N;
+double percentile_range_fun::operator () (const running_stats &s)
+{
+    if (s.n == 0)
+        return NAN;
+    double floor = std::max(s.percentile(0.1), volume_floor);
+    return 20.0 * log10(std::max(s.percentile(0.9), floor) / floor);
 }
 
-void audio::time_params::recalc()
+template <typename T>
+uint basic_audio<T>::time_params::reset()
 {
     if (overlap > frame_size)
         overlap = frame_size - 1;
 
     uint stride = frame_size - overlap;
-    uint ns = track.getNumSamplesPerChannel();
+    uint ns = track.size();
     uint nf = ns / stride + ((ns % stride > 0) ? 1 : 0);
-    double step = track.getLengthInSeconds() / static_cast<double>(nf - 1);
+    double step = length / static_cast<double>(nf - 1);
 
+    trace::count("allocations", (vals.capacity() < nf) + (time_vec.capacity() < nf));
     vals.resize(nf);
     time_vec.resize(nf);
+    for (uint i = 0; i < nf; i++)
+        time_vec[i] = static_cast<double>(i) * step;
+    gated_frames = 0;
+    stats = running_stats();
+    return nf;
+}
 
+template <typename T>
+void basic_audio<T>::time_params::recalc()
+{
+    trace::scope t([this]() { return fun.get_name(); });
+    uint nf = reset();
+    uint stride = frame_size - overlap;
+
+    volume_fun<T> volume;
     for (uint i = 0; i < nf; i++) {
-        vals[i] = fun(track.samples[0], i * stride, frame_size);
-        time_vec[i] =  static_cast<double>(i) * step;
+        if (gate && volume(track, i * stride, frame_size) < silence_volume) {
+            vals[i] = NAN;
+            gated_frames++;
+        } else {
+            vals[i] = fun(track, i * stride, frame_size);
+        }
+        stats.add(vals[i]);
     }
-}
\ No newline at end of file
+    trace::count("frames", nf - gated_frames);
+    trace::count("bytes touched", static_cast<int64_t>(nf - gated_frames) * frame_size * sizeof(T));
+}
+
+template <typename T>
+void basic_audio<T>::time_params::combine(const time_params &a, const time_params &b,
+                                          const std::function<double(double, double)> &f)
+{
+    if (a.frame_size != frame_size || a.overlap != overlap || b.frame_size != frame_size ||
+        b.overlap != overlap) {
+        recalc();
+        return;
+    }
+
+    vals.resize(a.vals.size());
+    time_vec = a.time_vec;
+    gated_frames = 0;
+    stats = running_stats();
+    for (uint i = 0; i < vals.size(); i++) {
+        vals[i] = f(a.vals[i], b.vals[i]);
+        stats.add(vals[i]);
+    }
+}
+
+static double relative_error(double ref, double val)
+{
+    if (!std::isfinite(ref) || !std::isfinite(val))
+        return (ref == val || (std::isnan(ref) && std::isnan(val))) ? 0.0 : INFINITY;
+
+    double diff = fabs(ref - val);
+    return diff > 0 ? diff / std::max(fabs(ref), std::numeric_limits<double>::epsilon()) : 0.0;
+}
+
+template <typename T>
+std::vector<precision_error> compare_precision(audio &ref, basic_audio<T> &test)
+{
+    std::vector<precision_error> errors;
+
+    for (uint c = 0; c < ref.channels.size() && c < test.channels.size(); c++) {
+        auto &ref_ch = ref.channels[c];
+        auto &test_ch = test.channels[c];
+        std::string prefix = ref.channels.size() > 1 ? "[" + ref_ch.name + "] " : "";
+
+        for (auto &tp : ref_ch.tps) {
+            auto it = test_ch.tps.find(tp.first);
+            if (it == test_ch.tps.end())
+                continue;
+
+            precision_error err = { prefix + tp.first, 0.0, 0.0 };
+            std::vector<double> &a = tp.second.vals;
+            std::vector<double> &b = it->second.vals;
+            for (uint i = 0; i < a.size() && i < b.size(); i++) {
+                double rel = relative_error(a[i], b[i]);
+                err.max_rel = std::max(err.max_rel, rel);
+                err.max_abs = std::max(err.max_abs, rel > 0 ? fabs(a[i] - b[i]) : 0.0);
+            }
+            errors.push_back(err);
+        }
+
+        for (auto &s : ref_ch.scalar_vals) {
+            auto it = test_ch.scalar_vals.find(s.first);
+            if (it == test_ch.scalar_vals.end())
+                continue;
+
+            double rel = relative_error(s.second, it->second);
+            errors.push_back({ prefix + s.first, rel > 0 ? fabs(s.second - it->second) : 0.0, rel });
+        }
+    }
+
+    return errors;
+}
+
+template class basic_audio<double>;
+template class basic_audio<float>;
+template class basic_audio<int16_t>;
+
+template std::vector<precision_error> compare_precision(audio &ref, audio_f32 &test);
+template std::vector<precision_error> compare_precision(audio &ref, audio_i16 &test);
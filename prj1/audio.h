@@ -1,163 +1,419 @@
+#pragma once
 #include "AudioFile.h"
+#include "wav_file.h"
+#include "resample.h"
+#include "feature_graph.h"
+#include "fft.h"
+#include "fir.h"
+#include <cmath>
 #include <map>
 #include <memory>
+#include <cstdint>
+#include <functional>
 typedef unsigned int uint;
 
+// Frames quieter than this (RMS) count as silence.
+static constexpr double silence_volume = 0.02;
+
+// Per sample type: accumulator used by the kernels and factor converting
+// a stored sample into the [-1, 1] range of the double path.
+template <typename T>
+struct sample_traits
+{
+    typedef double acc_t;
+    static constexpr double scale = 1.0;
+    static const char *name() { return "double"; }
+};
+
+template <>
+struct sample_traits<float>
+{
+    typedef float acc_t;
+    static constexpr double scale = 1.0;
+    static const char *name() { return "float32"; }
+};
+
+template <>
+struct sample_traits<int16_t>
+{
+    typedef int64_t acc_t;
+    static constexpr double scale = 1.0 / 32768.0;
+    static const char *name() { return "int16"; }
+};
+
+template <typename T>
 class frame_fun
 {
 public:
-    virtual double operator () (std::vector<double> main_ts, uint offset, uint frame_size) = 0;
+    virtual double operator () (pcm_view<T> main_ts, uint offset, uint frame_size) = 0;
     virtual std::string get_name() = 0;
+    // Expensive features that are meaningless on silent frames.
+    virtual bool gated() { return false; }
+    // Keeps state from one frame to the next, so a series must be computed in
+    // frame order on one thread.
+    virtual bool sequential() { return false; }
 };
 
-class volume_fun : public frame_fun
+template <typename T>
+class volume_fun : public frame_fun<T>
 {
 public:
-    double operator () (std::vector<double> main_ts, uint offset, uint frame_size) override;
+    double operator () (pcm_view<T> main_ts, uint offset, uint frame_size) override;
     std::string get_name() override { return "volume"; }
 };
 
-class ste_fun : public frame_fun
+template <typename T>
+class ste_fun : public frame_fun<T>
 {
 public:
-    double operator () (std::vector<double> main_ts, uint offset, uint frame_size) override;
+    double operator () (pcm_view<T> main_ts, uint offset, uint frame_size) override;
     std::string get_name() override { return "STE"; }
 };
 
-class zcr_fun : public frame_fun
+template <typename T>
+class zcr_fun : public frame_fun<T>
 {
 public:
-    double operator () (std::vector<double> main_ts, uint offset, uint frame_size) override;
+    double operator () (pcm_view<T> main_ts, uint offset, uint frame_size) override;
     std::string get_name() override { return "ZCR"; }
-    zcr_fun(AudioFile<double> &af) {
-        sampling_rate = static_cast<double>(af.getNumSamplesPerChannel()) / af.getLengthInSeconds();
-    }
+    zcr_fun(double fs) : sampling_rate(fs) {}
 private:
     double sampling_rate;
 };
 
 //silent ratio
-class sr_fun : public frame_fun
+template <typename T>
+class sr_fun : public frame_fun<T>
 {
 public:
-    double operator () (std::vector<double> main_ts, uint offset, uint frame_size) override;
+    double operator () (pcm_view<T> main_ts, uint offset, uint frame_size) override;
     std::string get_name() override { return "Silence ratio"; }
-    sr_fun(AudioFile<double> &af) : zf(af) {}
+    sr_fun(double fs) : zf(fs) {}
+    // Frames quieter than this count as silent.
+    double threshold = silence_volume;
 private:
-    volume_fun vf;
-    zcr_fun zf;
+    volume_fun<T> vf;
+    zcr_fun<T> zf;
 };
 
-class ff_fun : public frame_fun
+template <typename T>
+class ff_fun : public frame_fun<T>
 {
 public:
-    double operator () (std::vector<double> main_ts, uint offset, uint frame_size) override;
+    double operator () (pcm_view<T> main_ts, uint offset, uint frame_size) override;
     std::string get_name() override { return "Fundamental frequency"; }
-    ff_fun(AudioFile<double> &af) {
-        sampling_rate = static_cast<double>(af.getNumSamplesPerChannel()) / af.getLengthInSeconds();
-    }
+    bool gated() override { return true; }
+    // With factor > 1 the lag search runs on the decimated signal and is
+    // refined with a parabolic fit at the full rate.
+    ff_fun(double fs, decimation_cache<T> *dec = nullptr, uint dec_factor = 1)
+        : sampling_rate(fs), cache(dec), factor(dec_factor) {}
+private:
+    double sampling_rate;
+    decimation_cache<T> *cache;
+    uint factor;
+};
+
+// YIN pitch: the first lag where the cumulative mean normalised difference
+// dips below `threshold`, with the difference function taken from one FFT
+// autocorrelation. While tracking, a frame next to one with a clear pitch
+// only checks a narrow lag band around its period directly and falls back to
+// the full search when the dip there is not clear. NaN where there is no pitch.
+template <typename T>
+class yin_fun : public frame_fun<T>
+{
+public:
+    double operator () (pcm_view<T> main_ts, uint offset, uint frame_size) override;
+    std::string get_name() override { return "YIN pitch"; }
+    bool gated() override { return true; }
+    bool sequential() override { return tracking; }
+    yin_fun(double fs, bool track = true) : sampling_rate(fs), tracking(track) {}
+
+    static constexpr double threshold = 0.1;
+    // Half-width of the tracking band, relative to the previous period.
+    static constexpr double band = 0.06;
+    static constexpr double max_f0 = 1100.0;
+    // Frames decided by the tracking band and by the full search.
+    uint tracked = 0;
+    uint searched = 0;
 private:
+    double search(uint w, uint max_l, bool &clear);
+    double track(uint w, uint max_l, bool &clear);
+    double difference(uint w, uint l) const;
     double sampling_rate;
+    bool tracking;
+    // Previous frame, its period in samples is 0 when it had no clear pitch.
+    long prev_offset = -1;
+    double prev_period = 0.0;
+    std::vector<double> x;
+    std::vector<double> energy;
+    std::vector<double> d;
+    std::vector<dcomplex> buf;
 };
 
-class amdf_fun : public frame_fun
+// Runs any frame feature on the decimated signal; inner must be built for fs / factor.
+template <typename T>
+class decimated_fun : public frame_fun<T>
 {
 public:
-    double operator () (std::vector<double> main_ts, uint offset, uint frame_size) override;
+    double operator () (pcm_view<T> main_ts, uint offset, uint frame_size) override;
+    std::string get_name() override { return inner->get_name() + " /" + std::to_string(factor); }
+    bool gated() override { return inner->gated(); }
+    decimated_fun(std::unique_ptr<frame_fun<T>> f, decimation_cache<T> &dec, uint dec_factor)
+        : inner(std::move(f)), cache(dec), factor(dec_factor) {}
+private:
+    std::unique_ptr<frame_fun<T>> inner;
+    decimation_cache<T> &cache;
+    uint factor;
+};
+
+template <typename T>
+class amdf_fun : public frame_fun<T>
+{
+public:
+    double operator () (pcm_view<T> main_ts, uint offset, uint frame_size) override;
     std::string get_name() override { return "Fundamental frequency (AMDF)"; }
-    amdf_fun(AudioFile<double> &af) {
-        sampling_rate = static_cast<double>(af.getNumSamplesPerChannel()) / af.getLengthInSeconds();
-    }
+    bool gated() override { return true; }
+    amdf_fun(double fs) : sampling_rate(fs) {}
 private:
     double sampling_rate;
 };
 
+// Counts in a fixed number of equal bins. The range starts from the first
+// value and doubles, merging neighbouring bins, whenever a value falls
+// outside it, so the scale of a feature need not be known up front. Unlike
+// a marker-based quantile estimate it does not depend on the order of the
+// values, and its percentiles are within one bin of the exact ones: for
+// values of one sign, 1/64 of the largest magnitude.
+struct running_histogram
+{
+    static constexpr uint num_bins = 128;
+    double lo = 0.0;
+    double width = 0.0;
+    size_t counts[num_bins] = {};
+    size_t n = 0;
+
+    // v must be finite.
+    void add(double v);
+    // Fraction of the values below x, interpolated within its bin.
+    double fraction_below(double x) const;
+    // Value with a fraction p of the values below it, interpolated within
+    // its bin.
+    double quantile(double p) const;
+};
+
+// One-pass summary of a feature series, updated as each frame is computed:
+// Welford mean/variance and a histogram, both of constant size. NaN (gated)
+// frames are skipped, infinite ones are left out of the histogram.
+struct running_stats
+{
+    size_t n = 0;
+    double mean = 0.0;
+    double m2 = 0.0;
+    double min = INFINITY;
+    double max = -INFINITY;
+    running_histogram hist;
+
+    void add(double v);
+    double deviation() const { return sqrt(m2 / n); }
+    // Shares of the values below half and above 1.5 times the final mean,
+    // read from the histogram.
+    double low_ratio() const { return hist.fraction_below(0.5 * mean); }
+    double high_ratio() const { return 1.0 - hist.fraction_below(1.5 * mean); }
+    double percentile(double p) const;
+};
+
+// Silence threshold for a recording whose volume series is summarised by s:
+// a quarter of the way from its 10th to its 90th percentile, in dB, and at
+// least 20 dB below the 90th. Used instead of silence_volume when
+// analysis_options::adaptive_silence is set.
+double adaptive_silence_volume(const running_stats &s);
+
 class scalar_func
 {
 public:
-    virtual double operator () (std::vector<double>::iterator start, std::vector<double>::iterator end) = 0;
+    virtual double operator () (const running_stats &s) = 0;
     virtual std::string get_name() = 0;
 };
 
 class deviation_fun : public scalar_func
 {
 public:
-    double operator () (std::vector<double>::iterator start, std::vector<double>::iterator end) override;
+    double operator () (const running_stats &s) override;
     std::string get_name() override { return "deviation"; }
 };
 
 class deviation_norm_fun : public scalar_func
 {
 public:
-    double operator () (std::vector<double>::iterator start, std::vector<double>::iterator end) override;
+    double operator () (const running_stats &s) override;
     std::string get_name() override { return "normalized deviation"; }
 };
 
 class dynamic_range_func : public scalar_func
 {
 public:
-    double operator () (std::vector<double>::iterator start, std::vector<double>::iterator end) override;
+    double operator () (const running_stats &s) override;
     std::string get_name() override {return "dynamic range";}
 };
 
 class low_ratio_fun : public scalar_func
 {
 public:
-    double operator () (std::vector<double>::iterator start, std::vector<double>::iterator end) override;
+    double operator () (const running_stats &s) override;
     std::string get_name() override {return "low ratio"; }
 };
 
-class entropy_func : public scalar_func
+// Entropy of short-frame energies, each normalised by the long frame it starts in.
+double ste_entropy(const std::vector<double> &short_ste, uint short_stride,
+                   const std::vector<double> &long_ste, uint long_stride);
+
+class high_ratio_fun : public scalar_func
 {
 public:
-    public:
-    double operator () (std::vector<double>::iterator start, std::vector<double>::iterator end) override;
-    std::string get_name() override { return "entropy"; }
-    entropy_func(AudioFile<double> &af_in) : af(af_in) {}
-private:
-    AudioFile<double> &af;
+    double operator () (const running_stats &s) override;
+    std::string get_name() override {return "high ratio"; }
 };
 
-class high_ratio_fun : public scalar_func
+class median_fun : public scalar_func
 {
 public:
-    double operator () (std::vector<double>::iterator start, std::vector<double>::iterator end) override;
-    std::string get_name() override {return "high ratio"; }
+    double operator () (const running_stats &s) override;
+    std::string get_name() override { return "median"; }
 };
 
-class audio
+// 90th over 10th percentile in dB: a dynamic range that ignores the odd
+// click or dropout.
+class percentile_range_fun : public scalar_func
+{
+public:
+    double operator () (const running_stats &s) override;
+    std::string get_name() override { return "percentile range (dB)"; }
+};
+
+// Extra analysed signals derived from the file channels and evaluation mode.
+struct analysis_options
+{
+    bool mid_side = false;
+    bool downmix = false;
+    bool gate_silence = true;
+    // Silence ratio with a threshold from the file's own volume percentiles
+    // (adaptive_silence_volume) instead of the fixed silence_volume.
+    bool adaptive_silence = false;
+    // Decimation ahead of pitch search: 0 picks it from the sampling rate, 1 disables it.
+    uint pitch_decimation = 0;
+    // Decode, frame and analyse concurrently instead of one phase after the
+    // other. Mixes need every sample first, so they always load in phases.
+    bool pipelined = true;
+    // Applied to every channel (and mix) before any feature sees it.
+    filter_spec filter;
+    // Threads one load may keep busy; 0 for one per core. Files loaded side
+    // by side split the cores between them.
+    uint workers = 0;
+};
+
+template <typename T>
+class basic_audio
 {
 public:
     struct time_params {
         std::vector<double> vals;
         std::vector<double> time_vec;
-        frame_fun& fun;
+        frame_fun<T>& fun;
         uint frame_size;
         uint overlap;
-        AudioFile<double> &track;
+        pcm_view<T> track;
+        double length;
+        // Gated features are NaN on frames whose own volume is below silence_volume.
+        bool gate = false;
+        uint gated_frames = 0;
+        running_stats stats;
 
-        time_params(AudioFile<double> &af, frame_fun &ff, uint fs = 1200, uint ol = 20)
-            : fun(ff), track(af)
+        time_params(pcm_view<T> src, double length_s, frame_fun<T> &ff, uint fs = 1200, uint ol = 20,
+                    bool gate_silent = false, bool compute_now = true)
+            : fun(ff), track(src), length(length_s), gate(gate_silent)
         {
             frame_size = fs;
             overlap = ol;
-            recalc();
+            if (compute_now)
+                recalc();
         }
         void recalc();
+        // Sizes vals and time_vec for the frame grid and clears the summary;
+        // returns the number of frames.
+        uint reset();
+        // vals[i] = f(a.vals[i], b.vals[i]) when both are on this frame grid;
+        // otherwise falls back to recalc().
+        void combine(const time_params &a, const time_params &b, const std::function<double(double, double)> &f);
+    };
+    struct channel {
+        std::string name;
+        std::map<std::string, time_params> tps;
+        std::map<std::string, double> scalar_vals;
+        std::vector<std::unique_ptr<frame_fun<T>>> ffs;
+        std::vector<std::pair<std::string, std::unique_ptr<scalar_func>>> scalars;
+        // Series only other nodes read, e.g. the two STE scales behind entropy.
+        std::map<std::string, time_params> aux;
+        feature_graph graph;
     };
-    audio() {}
-    void init(std::string filename);
-    std::vector<double> &get_time_vec();
-    std::vector<double> &get_main_vec();
-    int num_samples() {return af.getNumSamplesPerChannel();}
-    std::map<std::string, time_params> tps;
-    std::map<std::string, double> scalar_vals;
-    ~audio();
+    basic_audio() {}
+    void init(std::string filename, analysis_options opts = analysis_options());
+    void unload();
+    pcm_view<T> get_view(uint c);
+    double sample_period() { return length / static_cast<double>(num_samples() - 1); }
+    double sampling_rate() { return fs; }
+    int num_samples() { return chans.empty() ? 0 : chans[0].size(); }
+    size_t sample_bytes();
+    bool is_mapped() { return wav.holds<T>(); }
+    const std::string &get_filename() { return filename; }
+    analysis_options get_options() { return opts; }
+    // Why the last init could not map or decode the file itself (it then
+    // falls back to AudioFile), or why it failed; empty otherwise.
+    const std::string &error() const { return err; }
+    // Moves one feature of channel c to a new frame grid and recomputes only
+    // the nodes that depend on it. Returns how many nodes ran.
+    uint set_frame(uint c, const std::string &feature, uint frame_size, uint overlap);
+    std::vector<channel> channels;
+    ~basic_audio();
     bool is_loaded();
 private:
-    AudioFile<double> af;
-    std::vector<double> tv;
-    std::vector<std::unique_ptr<frame_fun>> ffs;
-    std::vector<std::pair<std::string, std::unique_ptr<scalar_func>>> scalars;
+    AudioFile<T> af;
+    wav_file wav;
+    std::vector<std::vector<T>> decoded;
+    std::vector<std::vector<T>> derived;
+    std::vector<pcm_view<T>> chans;
+    decimation_cache<T> decimated;
+    // With a filter, chans point into filtered and unfiltered keeps the input.
+    fir_filter filter;
+    std::vector<std::vector<T>> filtered;
+    std::vector<pcm_view<T>> unfiltered;
+    double length = 0.0;
+    double fs = 0.0;
+    std::string filename;
+    std::string err;
+    analysis_options opts;
     bool loaded = false;
+    void add_mixes(analysis_options opts);
+    // Repoints chans at filtered copies; with fill, also filters them now.
+    void add_filter(bool fill);
+    void analyze(channel &ch, pcm_view<T> src, bool compute = true);
+    void run_pipeline();
 };
+
+// Runs fn(0) .. fn(n - 1) on up to max_workers threads, or up to
+// hardware_concurrency when it is 0.
+void parallel_for(uint n, const std::function<void(uint)> &fn, uint max_workers = 0);
+
+typedef basic_audio<double> audio;
+typedef basic_audio<float> audio_f32;
+typedef basic_audio<int16_t> audio_i16;
+
+// Worst deviation of one feature series (or scalar) from the double path.
+struct precision_error
+{
+    std::string name;
+    double max_abs;
+    double max_rel;
+};
+
+template <typename T>
+std::vector<precision_error> compare_precision(audio &ref, basic_audio<T> &test);
@@ -0,0 +1,579 @@
+// Micro-benchmarks for the frame features and scalars on deterministic
+// synthetic signals. Prints a table on stderr and writes JSON results, e.g.
+//   make bench                      (writes bench.json)
+//   ./sound_bench results.json
+// With --verify it instead checks the fast paths against their reference
+// implementations, the one-pass summaries and the feature file round trip,
+// and exits non-zero when a tolerance is exceeded:
+//   make verify
+//   ./sound_bench --verify [--abs-tol A] [--rel-tol R] [--rate-tol F]
+#include "audio.h"
+#include "feature_export.h"
+#include <cfloat>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <thread>
+#include <stdio.h>
+
+typedef std::chrono::steady_clock bench_clock;
+
+static constexpr double bench_fs = 44100.0;
+
+struct bench_signal {
+    std::string name;
+    std::vector<double> samples;
+};
+
+struct bench_result {
+    std::string kind;
+    std::string name;
+    std::string type;
+    std::string signal;
+    uint frame_size;
+    uint overlap;
+    // Time per signal sample, or per call for scalars that only read a summary.
+    double ns;
+    const char *per;
+    double gb_per_s;
+};
+
+// Log sine sweep, white noise and speech-like voiced bursts with pauses and
+// noise consonants, all from fixed seeds.
+static std::vector<bench_signal> make_signals(size_t n)
+{
+    std::vector<bench_signal> out(3);
+    out[0].name = "sweep";
+    out[1].name = "noise";
+    out[2].name = "speech";
+    for (auto &s : out)
+        s.samples.resize(n);
+
+    double f0 = 50.0, f1 = 8000.0, len = n / bench_fs;
+    double k = log(f1 / f0) / len;
+    for (size_t i = 0; i < n; i++) {
+        double t = i / bench_fs;
+        out[0].samples[i] = 0.5 * sin(2.0 * M_PI * f0 * (exp(k * t) - 1.0) / k);
+    }
+
+    std::mt19937 rng(12345);
+    for (size_t i = 0; i < n; i++)
+        out[1].samples[i] = 0.3 * (static_cast<double>(rng()) / rng.max() * 2.0 - 1.0);
+
+    // 250 ms syllables: 150 ms voiced with a gliding pitch, 30 ms consonant, pause.
+    double phase = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        double t = i / bench_fs;
+        double in_syl = fmod(t, 0.25);
+        uint syl = static_cast<uint>(t / 0.25);
+        double v = 0.0;
+        if (in_syl < 0.15) {
+            double pitch = 120.0 + 40.0 * (syl % 3) + 60.0 * in_syl;
+            phase += 2.0 * M_PI * pitch / bench_fs;
+            double env = sin(M_PI * in_syl / 0.15);
+            v = env * (0.4 * sin(phase) + 0.2 * sin(2.0 * phase) + 0.1 * sin(3.0 * phase + 0.5));
+        } else if (in_syl < 0.18) {
+            v = 0.05 * (static_cast<double>(rng()) / rng.max() * 2.0 - 1.0);
+        }
+        out[2].samples[i] = v;
+    }
+    return out;
+}
+
+template <typename T>
+static std::vector<T> convert(const std::vector<double> &in)
+{
+    std::vector<T> out(in.size());
+    for (size_t i = 0; i < in.size(); i++)
+        out[i] = static_cast<T>(in[i] / sample_traits<T>::scale);
+    return out;
+}
+
+// Seconds per call of fn: the best of `reps` runs, each repeating fn for at
+// least min_s so short kernels are not lost in clock resolution.
+static double time_best(const std::function<void()> &fn, uint reps = 3, double min_s = 0.01)
+{
+    double best = 1e30;
+    for (uint r = 0; r < reps; r++) {
+        uint calls = 0;
+        auto start = bench_clock::now();
+        double elapsed;
+        do {
+            fn();
+            calls++;
+            elapsed = std::chrono::duration<double>(bench_clock::now() - start).count();
+        } while (elapsed < min_s);
+        best = std::min(best, elapsed / calls);
+    }
+    return best;
+}
+
+// Every feature of one sample type over a whole signal at one frame grid.
+template <typename T>
+static void bench_features(const bench_signal &sig, uint frame_size, uint overlap,
+                           std::vector<bench_result> &results)
+{
+    std::vector<T> samples = convert<T>(sig.samples);
+    pcm_view<T> view(samples);
+    decimation_cache<T> dec;
+
+    std::vector<std::unique_ptr<frame_fun<T>>> ffs;
+    ffs.push_back(std::make_unique<volume_fun<T>>());
+    ffs.push_back(std::make_unique<ste_fun<T>>());
+    ffs.push_back(std::make_unique<zcr_fun<T>>(bench_fs));
+    ffs.push_back(std::make_unique<ff_fun<T>>(bench_fs, &dec, pitch_decimation(bench_fs)));
+    ffs.push_back(std::make_unique<yin_fun<T>>(bench_fs));
+    ffs.push_back(std::make_unique<sr_fun<T>>(bench_fs));
+
+    uint stride = frame_size - overlap;
+    uint nf = (view.size() - frame_size) / stride + 1;
+    volatile double sink = 0.0;
+    for (auto &ff : ffs) {
+        // Warm up, which also fills the decimation cache.
+        (*ff)(view, 0, frame_size);
+        double s = time_best([&]() {
+            double acc = 0.0;
+            for (uint i = 0; i < nf; i++)
+                acc += (*ff)(view, i * stride, frame_size);
+            sink = sink + acc;
+        });
+        double touched = static_cast<double>(nf) * frame_size;
+        results.push_back({ "frame_fun", ff->get_name(), sample_traits<T>::name(), sig.name, frame_size, overlap,
+                            1e9 * s / view.size(), "sample", touched * sizeof(T) / s * 1e-9 });
+    }
+}
+
+template <typename T>
+static void bench_scalars(const bench_signal &sig, std::vector<bench_result> &results)
+{
+    std::vector<T> samples = convert<T>(sig.samples);
+    pcm_view<T> view(samples);
+    double length = view.size() / bench_fs;
+    volume_fun<T> vf;
+    typename basic_audio<T>::time_params tp(view, length, vf);
+
+    std::vector<std::unique_ptr<scalar_func>> sfs;
+    sfs.push_back(std::make_unique<deviation_fun>());
+    sfs.push_back(std::make_unique<deviation_norm_fun>());
+    sfs.push_back(std::make_unique<dynamic_range_func>());
+    sfs.push_back(std::make_unique<low_ratio_fun>());
+    sfs.push_back(std::make_unique<high_ratio_fun>());
+    sfs.push_back(std::make_unique<percentile_range_fun>());
+    sfs.push_back(std::make_unique<median_fun>());
+
+    volatile double sink = 0.0;
+    for (auto &sf : sfs) {
+        double s = time_best([&]() { sink = sink + (*sf)(tp.stats); });
+        results.push_back({ "scalar_func", sf->get_name(), sample_traits<T>::name(), sig.name, 0, 0,
+                            1e9 * s, "call", 0.0 });
+    }
+
+    // The entropy node reads the two STE series the graph keeps, not the samples.
+    ste_fun<T> sf;
+    typename basic_audio<T>::time_params ste_short(view, length, sf, 100, 0);
+    typename basic_audio<T>::time_params ste_long(view, length, sf, 1200, 0);
+    double s = time_best([&]() { sink = sink + ste_entropy(ste_short.vals, 100, ste_long.vals, 1200); });
+    size_t touched = (ste_short.vals.size() + ste_long.vals.size()) * sizeof(double);
+    results.push_back({ "scalar_func", "entropy", sample_traits<T>::name(), sig.name, 100, 0,
+                        1e9 * s / view.size(), "sample", touched / s * 1e-9 });
+}
+
+static void write_json(const char *path, const std::vector<bench_result> &results)
+{
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "cannot write %s\n", path);
+        return;
+    }
+    fprintf(f, "{\n  \"project\": \"prj1\",\n  \"sampling_rate\": %.0f,\n  \"threads\": %u,\n  \"results\": [\n",
+            bench_fs, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < results.size(); i++) {
+        const bench_result &r = results[i];
+        fprintf(f, "    {\"kind\": \"%s\", \"name\": \"%s\", \"type\": \"%s\", \"signal\": \"%s\", "
+                   "\"frame_size\": %u, \"overlap\": %u, \"ns_per_%s\": %.4g, \"gb_per_s\": %.4g}%s\n",
+                r.kind.c_str(), r.name.c_str(), r.type.c_str(), r.signal.c_str(), r.frame_size, r.overlap,
+                r.per, r.ns, r.gb_per_s, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+}
+
+// A frame passes when its error is within abs or rel; a check passes when at
+// most `rate` of its frames fail (and a NaN on one side only always fails).
+struct check_tolerance {
+    double abs;
+    double rel;
+    double rate;
+};
+
+struct check_result {
+    std::string name;
+    std::string signal;
+    uint frames;
+    double max_abs;
+    double max_rel;
+    double mismatch;
+    bool pass;
+};
+
+static check_result compare(const std::string &name, const std::string &signal, const std::vector<double> &ref,
+                            const std::vector<double> &test, const check_tolerance &tol)
+{
+    check_result r = { name, signal, static_cast<uint>(ref.size()), 0.0, 0.0, 0.0, true };
+    uint bad = 0;
+    for (size_t i = 0; i < ref.size(); i++) {
+        double a = ref[i], b = test[i];
+        if (std::isnan(a) || std::isnan(b)) {
+            bad += std::isnan(a) != std::isnan(b);
+            continue;
+        }
+        double abs_err = fabs(a - b);
+        double rel_err = abs_err == 0.0 ? 0.0 : abs_err / fabs(a);
+        r.max_abs = std::max(r.max_abs, abs_err);
+        r.max_rel = std::max(r.max_rel, rel_err);
+        bad += abs_err > tol.abs && rel_err > tol.rel;
+    }
+    r.mismatch = ref.empty() ? 0.0 : static_cast<double>(bad) / ref.size();
+    r.pass = r.mismatch <= tol.rate;
+    return r;
+}
+
+template <typename T>
+static std::vector<double> series(frame_fun<T> &f, pcm_view<T> view, uint frame_size, uint overlap)
+{
+    uint stride = frame_size - overlap;
+    uint nf = (view.size() - frame_size) / stride + 1;
+    std::vector<double> out(nf);
+    for (uint i = 0; i < nf; i++)
+        out[i] = f(view, i * stride, frame_size);
+    return out;
+}
+
+// The typed kernels against the double ones on the very same (already
+// quantised) samples, so only the arithmetic differs.
+template <typename T>
+static void verify_type(const bench_signal &sig, uint frame_size, uint overlap, const check_tolerance &tol,
+                        std::vector<check_result> &out)
+{
+    std::vector<T> samples = convert<T>(sig.samples);
+    std::vector<double> exact(samples.size());
+    for (size_t i = 0; i < samples.size(); i++)
+        exact[i] = samples[i] * sample_traits<T>::scale;
+
+    std::vector<std::unique_ptr<frame_fun<T>>> fast;
+    std::vector<std::unique_ptr<frame_fun<double>>> ref;
+    fast.push_back(std::make_unique<volume_fun<T>>());
+    ref.push_back(std::make_unique<volume_fun<double>>());
+    fast.push_back(std::make_unique<ste_fun<T>>());
+    ref.push_back(std::make_unique<ste_fun<double>>());
+    fast.push_back(std::make_unique<zcr_fun<T>>(bench_fs));
+    ref.push_back(std::make_unique<zcr_fun<double>>(bench_fs));
+    fast.push_back(std::make_unique<sr_fun<T>>(bench_fs));
+    ref.push_back(std::make_unique<sr_fun<double>>(bench_fs));
+
+    std::string grid = " " + std::to_string(frame_size) + "/" + std::to_string(overlap);
+    for (uint i = 0; i < fast.size(); i++)
+        out.push_back(compare(fast[i]->get_name() + " " + sample_traits<T>::name() + grid, sig.name,
+                              series<double>(*ref[i], exact, frame_size, overlap),
+                              series<T>(*fast[i], samples, frame_size, overlap), tol));
+}
+
+// Pitch fast paths against full searches: decimated ff_fun against the
+// full-rate lag search, tracking YIN against the full YIN search.
+static void verify_pitch(const bench_signal &sig, uint frame_size, uint overlap, const check_tolerance &ff_tol,
+                         const check_tolerance &yin_tol, std::vector<check_result> &out)
+{
+    pcm_view<double> view(sig.samples);
+    decimation_cache<double> dec;
+    ff_fun<double> ff_fast(bench_fs, &dec, pitch_decimation(bench_fs));
+    ff_fun<double> ff_ref(bench_fs);
+    yin_fun<double> yin_fast(bench_fs, true);
+    yin_fun<double> yin_ref(bench_fs, false);
+    volume_fun<double> vf;
+
+    // Only voiced frames count, as in the gated analysis.
+    std::vector<double> vol = series<double>(vf, view, frame_size, overlap);
+    auto gated = [&](std::vector<double> v) {
+        for (size_t i = 0; i < v.size(); i++)
+            if (vol[i] < silence_volume)
+                v[i] = NAN;
+        return v;
+    };
+
+    std::string grid = " " + std::to_string(frame_size) + "/" + std::to_string(overlap);
+    out.push_back(compare("Fundamental frequency decimated" + grid, sig.name,
+                          gated(series<double>(ff_ref, view, frame_size, overlap)),
+                          gated(series<double>(ff_fast, view, frame_size, overlap)), ff_tol));
+    out.push_back(compare("YIN pitch tracking" + grid, sig.name,
+                          gated(series<double>(yin_ref, view, frame_size, overlap)),
+                          gated(series<double>(yin_fast, view, frame_size, overlap)), yin_tol));
+
+    // A gated series measures the volume of its own frames, whatever grid
+    // the volume feature is shown on.
+    ff_fun<double> ff_gated(bench_fs);
+    basic_audio<double>::time_params tp(view, view.size() / bench_fs, ff_gated, frame_size, overlap, true);
+    std::vector<double> ref = gated(series<double>(ff_ref, view, frame_size, overlap));
+    out.push_back(compare("gate on own frames" + grid, sig.name, ref,
+                          std::vector<double>(tp.vals.begin(), tp.vals.begin() + ref.size()), check_tolerance{}));
+}
+
+// The one-pass summaries against exact two-pass figures: the histogram low
+// and high ratios against counts around the final mean, and its percentiles
+// by their distance from the order statistics around p, as a fraction of the
+// largest value.
+static void verify_sketches(const bench_signal &sig, uint frame_size, uint overlap, const check_tolerance &ratio_tol,
+                            const check_tolerance &pct_tol, std::vector<check_result> &out)
+{
+    pcm_view<double> view(sig.samples);
+    volume_fun<double> vf;
+    ste_fun<double> sf;
+    zcr_fun<double> zf(bench_fs);
+    yin_fun<double> yf(bench_fs);
+
+    std::string grid = " " + std::to_string(frame_size) + "/" + std::to_string(overlap);
+    for (frame_fun<double> *f : std::initializer_list<frame_fun<double> *>{ &vf, &sf, &zf, &yf }) {
+        std::vector<double> vals = series<double>(*f, view, frame_size, overlap);
+        running_stats s;
+        for (double v : vals)
+            s.add(v);
+
+        std::vector<double> sorted;
+        size_t low = 0, high = 0;
+        for (double v : vals) {
+            if (!std::isfinite(v))
+                continue;
+            sorted.push_back(v);
+            low += v < 0.5 * s.mean;
+            high += v > 1.5 * s.mean;
+        }
+        if (sorted.empty())
+            continue;
+        std::sort(sorted.begin(), sorted.end());
+        double n = sorted.size();
+        double scale = std::max(fabs(sorted.front()), fabs(sorted.back()));
+        auto off = [&](double p) {
+            double v = s.percentile(p);
+            double below = sorted[static_cast<size_t>(p * (n - 1))];
+            double above = sorted[std::min<size_t>(n - 1, ceil(p * n))];
+            double d = v < below ? below - v : v > above ? v - above : 0.0;
+            return scale > 0.0 ? d / scale : d;
+        };
+
+        check_result r = compare(f->get_name() + " low/high ratio" + grid, sig.name, { low / n, high / n },
+                                 { s.low_ratio(), s.high_ratio() }, ratio_tol);
+        r.frames = sorted.size();
+        out.push_back(r);
+        r = compare(f->get_name() + " p10/median/p90" + grid, sig.name, { 0.0, 0.0, 0.0 },
+                    { off(0.1), off(0.5), off(0.9) }, pct_tol);
+        // Already relative to the largest value.
+        r.max_rel = r.max_abs;
+        r.frames = sorted.size();
+        out.push_back(r);
+    }
+}
+
+// Failed unless ref and test hold the very same bits, NaNs included.
+static check_result compare_bits(const std::string &name, const std::string &signal,
+                                 const std::vector<double> &ref, const std::vector<double> &test)
+{
+    check_result r = { name, signal, static_cast<uint>(ref.size()), 0.0, 0.0, 1.0, false };
+    if (test.size() != ref.size())
+        return r;
+    uint bad = 0;
+    for (size_t i = 0; i < ref.size(); i++) {
+        if (memcmp(&ref[i], &test[i], sizeof(double)) == 0)
+            continue;
+        bad++;
+        if (std::isfinite(ref[i]) && std::isfinite(test[i]))
+            r.max_abs = std::max(r.max_abs, fabs(ref[i] - test[i]));
+    }
+    r.mismatch = ref.empty() ? 0.0 : static_cast<double>(bad) / ref.size();
+    r.pass = bad == 0;
+    return r;
+}
+
+// Values past the float range as a float32 column keeps them: infinite.
+static std::vector<double> beyond_float(std::vector<double> v)
+{
+    for (double &x : v)
+        if (fabs(x) > FLT_MAX)
+            x = copysign(INFINITY, x);
+    return v;
+}
+
+// Round trips through the feature file: raw and xor_delta columns must come
+// back bit for bit, float32 ones within float rounding (half an ulp relative,
+// or the smallest float). A file whose writer has not closed it and files
+// cut short in the chunks or in the directory must be refused.
+static void verify_feature_file(const std::vector<bench_signal> &corpus, std::vector<check_result> &out)
+{
+    std::vector<std::pair<std::string, std::vector<double>>> columns;
+    for (auto &sig : corpus) {
+        columns.push_back({ sig.name + "/samples", sig.samples });
+        volume_fun<double> vf;
+        columns.push_back({ sig.name + "/volume", series<double>(vf, sig.samples, 256, 240) });
+    }
+    columns.push_back({ "edge/values", { 0.0, -0.0, 1.0, 1.0, NAN, INFINITY, -INFINITY, DBL_MAX, DBL_MIN,
+                                         5e-324, 1e-310, -3.5, 1e300, FLT_MAX, FLT_MIN, 0.1 } });
+
+    std::filesystem::path dir = std::filesystem::temp_directory_path();
+    std::string path = (dir / "sound_bench_verify.features").string();
+    const feature_writer::encoding encs[] = { feature_writer::raw, feature_writer::xor_delta, feature_writer::float32 };
+    const char *enc_names[] = { "raw", "xor_delta", "float32" };
+    check_tolerance f32_tol = { FLT_TRUE_MIN, FLT_EPSILON / 2, 0.0 };
+    for (uint e = 0; e < 3; e++) {
+        feature_writer w;
+        bool written = w.open(path, bench_fs);
+        for (auto &col : columns) {
+            feature_writer::column_info info;
+            info.name = col.first;
+            info.enc = encs[e];
+            w.append(w.add_column(info), col.second.data(), col.second.size());
+        }
+        written = w.close() && written;
+
+        feature_reader r;
+        bool opened = written && r.open(path);
+        for (auto &col : columns) {
+            std::string name = std::string("feature file ") + enc_names[e];
+            std::string signal = col.first.substr(0, col.first.find('/'));
+            std::vector<double> back;
+            int c = opened ? r.find(col.first) : -1;
+            if (c < 0 || !r.read(c, back) || back.size() != col.second.size())
+                out.push_back({ name + " " + col.first, signal, static_cast<uint>(col.second.size()), 0.0, 0.0, 1.0,
+                                false });
+            else if (encs[e] == feature_writer::float32)
+                out.push_back(compare(name + " " + col.first, signal, beyond_float(col.second), back, f32_tol));
+            else
+                out.push_back(compare_bits(name + " " + col.first, signal, col.second, back));
+        }
+    }
+
+    // The file of the last round, refused when incomplete.
+    auto refused = [&](const std::string &name, const std::string &file) {
+        feature_reader r;
+        bool ok = r.open(file);
+        out.push_back({ "feature file " + name + " refused", "edge", 0, 0.0, 0.0, ok ? 1.0 : 0.0, !ok });
+    };
+    uintmax_t size = std::filesystem::file_size(path);
+    std::string cut = (dir / "sound_bench_verify_cut.features").string();
+    std::filesystem::copy_file(path, cut, std::filesystem::copy_options::overwrite_existing);
+    std::filesystem::resize_file(cut, size / 2);
+    refused("cut in the chunks", cut);
+    std::filesystem::copy_file(path, cut, std::filesystem::copy_options::overwrite_existing);
+    std::filesystem::resize_file(cut, size - 4);
+    refused("cut in the directory", cut);
+    {
+        feature_writer w;
+        w.open(cut, bench_fs);
+        uint c = w.add_column(feature_writer::column_info());
+        w.append(c, columns[0].second.data(), columns[0].second.size());
+        refused("still being written", cut);
+    }
+    std::filesystem::remove(cut);
+    std::filesystem::remove(path);
+}
+
+static int verify(int argc, char **argv)
+{
+    // Defaults: float32 sums over long frames keep 4-5 digits, int16 sums are
+    // exact. A pitch is off when it is more than 3% away; the decimated ff
+    // search slips an octave at voicing edges, YIN tracking should not.
+    check_tolerance f32_tol = { 1e-9, 1e-4, 0.0 };
+    check_tolerance i16_tol = { 1e-9, 1e-9, 0.0 };
+    check_tolerance ff_tol = { 0.0, 0.03, 0.15 };
+    check_tolerance yin_tol = { 0.0, 0.03, 0.02 };
+    // The histogram interpolates within a bin, which keeps the low and high
+    // ratios within 2 points of the exact counts and its percentiles within
+    // one bin, 1/64 of the largest value.
+    check_tolerance ratio_tol = { 0.02, 0.0, 0.0 };
+    check_tolerance pct_tol = { 1.0 / 64, 0.0, 0.0 };
+    for (int i = 2; i + 1 < argc; i += 2) {
+        double v = atof(argv[i + 1]);
+        for (check_tolerance *t : { &f32_tol, &i16_tol, &ff_tol, &yin_tol, &ratio_tol, &pct_tol }) {
+            if (!strcmp(argv[i], "--abs-tol"))
+                t->abs = v;
+            else if (!strcmp(argv[i], "--rel-tol"))
+                t->rel = v;
+            else if (!strcmp(argv[i], "--rate-tol"))
+                t->rate = v;
+        }
+    }
+
+    // The benchmark signals plus steady tones, a quiet take and a DC offset.
+    // Pitch is only compared where there is one: not on the sweep (it leaves
+    // the pitch range) nor on noise.
+    std::vector<bench_signal> corpus = make_signals(static_cast<size_t>(bench_fs));
+    size_t n = corpus[0].samples.size();
+    bench_signal tones = { "tones", std::vector<double>(n) };
+    bench_signal quiet = { "quiet", corpus[2].samples };
+    bench_signal offset = { "offset", corpus[2].samples };
+    for (size_t i = 0; i < n; i++) {
+        double f = 80.0 * pow(2.0, static_cast<uint>(i / (0.1 * bench_fs)) % 10 / 3.0);
+        tones.samples[i] = 0.3 * sin(2.0 * M_PI * f * i / bench_fs) + 0.1 * sin(4.0 * M_PI * f * i / bench_fs);
+        quiet.samples[i] *= 0.1;
+        offset.samples[i] = 0.5 * offset.samples[i] + 0.2;
+    }
+    corpus.push_back(tones);
+    corpus.push_back(quiet);
+    corpus.push_back(offset);
+
+    std::vector<check_result> results;
+    const uint grids[][2] = { { 1200, 20 }, { 256, 0 }, { 4096, 2048 } };
+    for (auto &sig : corpus) {
+        for (auto &g : grids) {
+            verify_type<float>(sig, g[0], g[1], f32_tol, results);
+            verify_type<int16_t>(sig, g[0], g[1], i16_tol, results);
+        }
+        verify_sketches(sig, 256, 0, ratio_tol, pct_tol, results);
+        if (sig.name == "sweep" || sig.name == "noise")
+            continue;
+        verify_pitch(sig, 1200, 20, ff_tol, yin_tol, results);
+        verify_pitch(sig, 2048, 1024, ff_tol, yin_tol, results);
+    }
+    verify_feature_file(corpus, results);
+
+    uint failed = 0;
+    printf("%-4s %-42s %-7s %6s %11s %11s %9s\n", "", "check", "signal", "frames", "max abs", "max rel", "mismatch");
+    for (auto &r : results) {
+        failed += !r.pass;
+        printf("%-4s %-42s %-7s %6u %11.3g %11.3g %8.2f%%\n", r.pass ? "ok" : "FAIL", r.name.c_str(),
+               r.signal.c_str(), r.frames, r.max_abs, r.max_rel, 100.0 * r.mismatch);
+    }
+    printf("%zu checks, %u failed\n", results.size(), failed);
+    return failed ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && !strcmp(argv[1], "--verify"))
+        return verify(argc, argv);
+
+    const char *out = argc > 1 ? argv[1] : "bench.json";
+    std::vector<bench_signal> signals = make_signals(static_cast<size_t>(bench_fs));
+    std::vector<bench_result> results;
+
+    const uint frame_sizes[] = { 256, 512, 1200, 2048, 4096 };
+    for (auto &sig : signals) {
+        for (uint fsz : frame_sizes) {
+            bench_features<double>(sig, fsz, 0, results);
+            bench_features<double>(sig, fsz, fsz / 2, results);
+        }
+        // The other sample types on the default grid.
+        bench_features<float>(sig, 1200, 20, results);
+        bench_features<int16_t>(sig, 1200, 20, results);
+        bench_scalars<double>(sig, results);
+        bench_scalars<float>(sig, results);
+        bench_scalars<int16_t>(sig, results);
+    }
+
+    fprintf(stderr, "%-12s %-24s %-8s %-7s %6s %6s %12s %-7s %8s\n", "kind", "name", "type", "signal", "frame",
+            "ovl", "ns", "per", "GB/s");
+    for (auto &r : results)
+        fprintf(stderr, "%-12s %-24s %-8s %-7s %6u %6u %12.3f %-7s %8.3f\n", r.kind.c_str(), r.name.c_str(),
+                r.type.c_str(), r.signal.c_str(), r.frame_size, r.overlap, r.ns, r.per, r.gb_per_s);
+    write_json(out, results);
+    fprintf(stderr, "wrote %zu results to %s\n", results.size(), out);
+    return 0;
+}
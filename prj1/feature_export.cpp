@@ -0,0 +1,460 @@
+#include "feature_export.h"
+#include "trace.h"
+#include <cstring>
+
+static const char feature_magic[8] = { 'S', 'N', 'D', 'F', 'E', 'A', 'T', '1' };
+// magic, rate, chunk_frames, reserved, directory offset
+static constexpr size_t header_bytes = 8 + 8 + 4 + 4 + 8;
+
+static void put(std::vector<uint8_t> &out, const void *data, size_t bytes)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    out.insert(out.end(), p, p + bytes);
+}
+
+template <typename V>
+static void put(std::vector<uint8_t> &out, V v)
+{
+    put(out, &v, sizeof(v));
+}
+
+static void put_name(std::vector<uint8_t> &out, const std::string &name)
+{
+    put<uint32_t>(out, name.size());
+    put(out, name.data(), name.size());
+}
+
+static void pack(const double *vals, size_t n, feature_writer::encoding enc, std::vector<uint8_t> &out)
+{
+    out.clear();
+    if (enc == feature_writer::raw) {
+        put(out, vals, n * sizeof(double));
+    } else if (enc == feature_writer::float32) {
+        for (size_t i = 0; i < n; i++)
+            put(out, static_cast<float>(vals[i]));
+    } else {
+        // One control byte per value, trailing zero bytes << 4 | bytes kept,
+        // then the kept bytes, lowest first. Each chunk starts from 0.
+        uint64_t prev = 0;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t bits;
+            memcpy(&bits, &vals[i], sizeof(bits));
+            uint64_t x = bits ^ prev;
+            prev = bits;
+            uint trail = 0, len = 0;
+            if (x) {
+                while (!(x >> (8 * trail) & 0xff))
+                    trail++;
+                len = 8 - trail;
+                while (!(x >> (8 * (trail + len - 1)) & 0xff))
+                    len--;
+            }
+            out.push_back(static_cast<uint8_t>(trail << 4 | len));
+            for (uint b = 0; b < len; b++)
+                out.push_back(static_cast<uint8_t>(x >> (8 * (trail + b))));
+        }
+    }
+}
+
+static bool unpack(const uint8_t *data, size_t bytes, feature_writer::encoding enc, size_t n, double *out)
+{
+    if (enc == feature_writer::raw) {
+        if (bytes != n * sizeof(double))
+            return false;
+        memcpy(out, data, bytes);
+        return true;
+    }
+    if (enc == feature_writer::float32) {
+        if (bytes != n * sizeof(float))
+            return false;
+        for (size_t i = 0; i < n; i++) {
+            float v;
+            memcpy(&v, data + i * sizeof(float), sizeof(float));
+            out[i] = v;
+        }
+        return true;
+    }
+    if (enc != feature_writer::xor_delta)
+        return false;
+
+    const uint8_t *end = data + bytes;
+    uint64_t prev = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (data == end)
+            return false;
+        uint trail = *data >> 4, len = *data & 0xf;
+        data++;
+        if (trail + len > 8 || static_cast<size_t>(end - data) < len)
+            return false;
+        uint64_t x = 0;
+        for (uint b = 0; b < len; b++)
+            x |= static_cast<uint64_t>(*data++) << (8 * (trail + b));
+        prev ^= x;
+        memcpy(&out[i], &prev, sizeof(prev));
+    }
+    return data == end;
+}
+
+bool feature_writer::open(const std::string &path, double sampling_rate)
+{
+    close();
+    f = fopen(path.c_str(), "wb");
+    if (!f)
+        return false;
+    ok = true;
+    pos = 0;
+    rate = sampling_rate;
+    std::vector<uint8_t> header;
+    put(header, feature_magic, sizeof(feature_magic));
+    put(header, rate);
+    put<uint32_t>(header, chunk_frames);
+    put<uint32_t>(header, 0);
+    put<uint64_t>(header, 0);
+    write(header.data(), header.size());
+    return ok;
+}
+
+uint feature_writer::add_column(const column_info &info)
+{
+    columns.emplace_back();
+    columns.back().info = info;
+    return columns.size() - 1;
+}
+
+void feature_writer::write(const void *data, size_t bytes)
+{
+    if (ok && fwrite(data, 1, bytes, f) != bytes)
+        ok = false;
+    pos += bytes;
+}
+
+void feature_writer::flush_chunk(column &col)
+{
+    if (col.pending.empty())
+        return;
+    pack(col.pending.data(), col.pending.size(), col.info.enc, packed);
+    col.chunks.push_back({ pos, static_cast<uint32_t>(col.pending.size()), static_cast<uint32_t>(packed.size()) });
+    write(packed.data(), packed.size());
+    trace::count("bytes exported", packed.size());
+    col.pending.clear();
+}
+
+void feature_writer::append(uint c, const double *vals, size_t n)
+{
+    column &col = columns[c];
+    col.frames += n;
+    while (n > 0) {
+        size_t take = std::min<size_t>(n, chunk_frames - col.pending.size());
+        col.pending.insert(col.pending.end(), vals, vals + take);
+        vals += take;
+        n -= take;
+        if (col.pending.size() == chunk_frames)
+            flush_chunk(col);
+    }
+}
+
+void feature_writer::add_scalar(const std::string &name, double v)
+{
+    scalars.emplace_back(name, v);
+}
+
+bool feature_writer::close()
+{
+    if (!f)
+        return false;
+
+    for (auto &col : columns)
+        flush_chunk(col);
+
+    uint64_t directory = pos;
+    std::vector<uint8_t> dir;
+    put<uint32_t>(dir, columns.size());
+    for (auto &col : columns) {
+        put_name(dir, col.info.name);
+        put<uint32_t>(dir, col.info.frame_size);
+        put<uint32_t>(dir, col.info.overlap);
+        put(dir, col.info.t0);
+        put(dir, col.info.step);
+        put<uint32_t>(dir, col.info.enc);
+        put(dir, col.frames);
+        put<uint32_t>(dir, col.chunks.size());
+        for (auto &ch : col.chunks) {
+            put(dir, ch.offset);
+            put(dir, ch.frames);
+            put(dir, ch.bytes);
+        }
+    }
+    put<uint32_t>(dir, scalars.size());
+    for (auto &s : scalars) {
+        put_name(dir, s.first);
+        put(dir, s.second);
+    }
+    write(dir.data(), dir.size());
+
+    // The directory offset goes in last, so a file cut short reads as unfinished.
+    if (ok && (fseek(f, header_bytes - sizeof(directory), SEEK_SET) != 0 ||
+               fwrite(&directory, sizeof(directory), 1, f) != 1))
+        ok = false;
+    if (fclose(f) != 0)
+        ok = false;
+    f = nullptr;
+    columns.clear();
+    scalars.clear();
+    return ok;
+}
+
+feature_reader::~feature_reader()
+{
+    if (f)
+        fclose(f);
+}
+
+bool feature_reader::fail(const std::string &msg)
+{
+    err = msg;
+    if (f)
+        fclose(f);
+    f = nullptr;
+    descs.clear();
+    chunks.clear();
+    scalar_vals.clear();
+    return false;
+}
+
+bool feature_reader::open(const std::string &path)
+{
+    if (f)
+        fclose(f);
+    descs.clear();
+    chunks.clear();
+    scalar_vals.clear();
+    err.clear();
+    f = fopen(path.c_str(), "rb");
+    if (!f)
+        return fail("cannot open " + path);
+
+    uint8_t header[header_bytes];
+    if (fread(header, 1, header_bytes, f) != header_bytes || memcmp(header, feature_magic, sizeof(feature_magic)))
+        return fail("not a feature file");
+    uint64_t directory;
+    memcpy(&rate, header + 8, sizeof(rate));
+    memcpy(&directory, header + header_bytes - sizeof(directory), sizeof(directory));
+    if (directory == 0)
+        return fail("feature file was not closed");
+
+    if (fseek(f, 0, SEEK_END) != 0)
+        return fail("cannot seek");
+    long size = ftell(f);
+    if (size < 0 || directory > static_cast<uint64_t>(size) || fseek(f, directory, SEEK_SET) != 0)
+        return fail("bad directory offset");
+    std::vector<uint8_t> dir(size - directory);
+    if (fread(dir.data(), 1, dir.size(), f) != dir.size())
+        return fail("cannot read directory");
+
+    size_t at = 0;
+    bool short_read = false;
+    auto get = [&](void *out, size_t bytes) {
+        if (dir.size() - at < bytes) {
+            short_read = true;
+            memset(out, 0, bytes);
+            return;
+        }
+        memcpy(out, dir.data() + at, bytes);
+        at += bytes;
+    };
+    auto get_u32 = [&]() { uint32_t v; get(&v, sizeof(v)); return v; };
+    auto get_name = [&]() {
+        uint32_t n = get_u32();
+        if (dir.size() - at < n) {
+            short_read = true;
+            return std::string();
+        }
+        std::string s(reinterpret_cast<const char *>(dir.data() + at), n);
+        at += n;
+        return s;
+    };
+
+    uint32_t nc = get_u32();
+    for (uint32_t c = 0; c < nc && !short_read; c++) {
+        column_desc d;
+        d.info.name = get_name();
+        d.info.frame_size = get_u32();
+        d.info.overlap = get_u32();
+        get(&d.info.t0, sizeof(d.info.t0));
+        get(&d.info.step, sizeof(d.info.step));
+        d.info.enc = static_cast<feature_writer::encoding>(get_u32());
+        get(&d.frames, sizeof(d.frames));
+        uint32_t n = get_u32();
+        std::vector<chunk_ref> refs;
+        for (uint32_t k = 0; k < n && !short_read; k++) {
+            chunk_ref r;
+            get(&r.offset, sizeof(r.offset));
+            get(&r.frames, sizeof(r.frames));
+            get(&r.bytes, sizeof(r.bytes));
+            refs.push_back(r);
+        }
+        descs.push_back(d);
+        chunks.push_back(std::move(refs));
+    }
+    uint32_t ns = get_u32();
+    for (uint32_t s = 0; s < ns && !short_read; s++) {
+        std::string name = get_name();
+        double v;
+        get(&v, sizeof(v));
+        scalar_vals.emplace_back(name, v);
+    }
+    if (short_read)
+        return fail("truncated directory");
+    return true;
+}
+
+int feature_reader::find(const std::string &name) const
+{
+    for (uint c = 0; c < descs.size(); c++)
+        if (descs[c].info.name == name)
+            return c;
+    return -1;
+}
+
+bool feature_reader::read(uint column, std::vector<double> &out)
+{
+    if (!f || column >= descs.size())
+        return false;
+    out.resize(descs[column].frames);
+    size_t filled = 0;
+    std::vector<uint8_t> data;
+    for (auto &r : chunks[column]) {
+        data.resize(r.bytes);
+        if (filled + r.frames > out.size() || fseek(f, r.offset, SEEK_SET) != 0 ||
+            fread(data.data(), 1, r.bytes, f) != r.bytes ||
+            !unpack(data.data(), r.bytes, descs[column].info.enc, r.frames, out.data() + filled)) {
+            err = "bad chunk in " + descs[column].info.name;
+            return false;
+        }
+        filled += r.frames;
+    }
+    return filled == out.size();
+}
+
+bool csv_writer::open(const std::string &path, size_t buffer_bytes)
+{
+    close();
+    f = fopen(path.c_str(), "w");
+    if (!f)
+        return false;
+    ok = true;
+    limit = buffer_bytes;
+    buf = "column,frame,time,value\n";
+    return true;
+}
+
+// Quoted when it holds a separator, a quote or a line break.
+void csv_writer::add_name(const std::string &name)
+{
+    if (name.find_first_of(",\"\n") == std::string::npos) {
+        buf += name;
+        return;
+    }
+    buf += '"';
+    for (char c : name) {
+        if (c == '"')
+            buf += '"';
+        buf += c;
+    }
+    buf += '"';
+}
+
+void csv_writer::row(const std::string &column, size_t frame, double time, double value)
+{
+    char text[96];
+    snprintf(text, sizeof(text), ",%zu,%.9g,%.17g\n", frame, time, value);
+    add_name(column);
+    buf += text;
+    if (buf.size() >= limit)
+        flush();
+}
+
+void csv_writer::scalar(const std::string &name, double value)
+{
+    char text[64];
+    snprintf(text, sizeof(text), ",,,%.17g\n", value);
+    add_name(name);
+    buf += text;
+    if (buf.size() >= limit)
+        flush();
+}
+
+void csv_writer::flush()
+{
+    if (ok && fwrite(buf.data(), 1, buf.size(), f) != buf.size())
+        ok = false;
+    buf.clear();
+}
+
+bool csv_writer::close()
+{
+    if (!f)
+        return false;
+    flush();
+    if (fclose(f) != 0)
+        ok = false;
+    f = nullptr;
+    return ok;
+}
+
+// scalar_vals keys read "name (feature): " for display.
+static std::string scalar_name(const std::string &key)
+{
+    size_t end = key.find_last_not_of(": ");
+    return key.substr(0, end == std::string::npos ? 0 : end + 1);
+}
+
+template <typename T>
+bool export_features(basic_audio<T> &a, const std::string &path, feature_writer::encoding enc)
+{
+    trace::scope t("export features");
+    feature_writer w;
+    if (!w.open(path, a.sampling_rate()))
+        return false;
+    for (auto &ch : a.channels) {
+        for (auto &tp : ch.tps) {
+            const std::vector<double> &tv = tp.second.time_vec;
+            feature_writer::column_info info;
+            info.name = ch.name + "/" + tp.first;
+            info.frame_size = tp.second.frame_size;
+            info.overlap = tp.second.overlap;
+            info.step = tv.size() > 1 ? tv[1] - tv[0] : 0.0;
+            info.enc = enc;
+            w.append(w.add_column(info), tp.second.vals.data(), tp.second.vals.size());
+        }
+        for (auto &s : ch.scalar_vals)
+            w.add_scalar(ch.name + "/" + scalar_name(s.first), s.second);
+    }
+    return w.close();
+}
+
+template <typename T>
+bool export_csv(basic_audio<T> &a, const std::string &path)
+{
+    trace::scope t("export csv");
+    csv_writer w;
+    if (!w.open(path))
+        return false;
+    for (auto &ch : a.channels) {
+        for (auto &tp : ch.tps) {
+            std::string name = ch.name + "/" + tp.first;
+            for (size_t i = 0; i < tp.second.vals.size(); i++)
+                w.row(name, i, tp.second.time_vec[i], tp.second.vals[i]);
+        }
+        for (auto &s : ch.scalar_vals)
+            w.scalar(ch.name + "/" + scalar_name(s.first), s.second);
+    }
+    return w.close();
+}
+
+template bool export_features(basic_audio<double> &a, const std::string &path, feature_writer::encoding enc);
+template bool export_features(basic_audio<float> &a, const std::string &path, feature_writer::encoding enc);
+template bool export_features(basic_audio<int16_t> &a, const std::string &path, feature_writer::encoding enc);
+template bool export_csv(basic_audio<double> &a, const std::string &path);
+template bool export_csv(basic_audio<float> &a, const std::string &path);
+template bool export_csv(basic_audio<int16_t> &a, const std::string &path);
@@ -0,0 +1,155 @@
+#pragma once
+#include "audio.h"
+#include <cstdio>
+
+// Columnar feature file, little-endian, written front to back in one pass:
+//   header     "SNDFEAT1", double sampling rate, uint32 chunk_frames,
+//              uint32 0, uint64 offset of the directory (0 until closed)
+//   chunks     up to chunk_frames values of one column each, in the order
+//              the columns filled them
+//   directory  uint32 columns, then per column: name, uint32 frame_size,
+//              uint32 overlap, double t0, double step, uint32 encoding,
+//              uint64 frames, uint32 chunks and per chunk uint64 offset,
+//              uint32 frames, uint32 bytes; then uint32 scalars and per
+//              scalar name, double value. Names are uint32 length + bytes.
+// Frame i of a column is at t0 + i * step seconds. A reader needs the header
+// and the directory, then only the chunks of the columns it wants; raw chunks
+// are plain doubles that can be used straight from a mapping.
+class feature_writer
+{
+public:
+    enum encoding : uint32_t {
+        raw = 0,
+        // Lossless: each value's bits XORed with the previous value's, with
+        // leading and trailing zero bytes dropped. Slowly changing series
+        // share sign, exponent and top mantissa bytes, so most of it goes.
+        xor_delta = 1,
+        // Values rounded to float, half the size of raw.
+        float32 = 2,
+    };
+    struct column_info {
+        std::string name;
+        uint frame_size = 0;
+        uint overlap = 0;
+        double t0 = 0.0;
+        double step = 0.0;
+        encoding enc = xor_delta;
+    };
+    static constexpr uint chunk_frames = 4096;
+
+    feature_writer() {}
+    feature_writer(const feature_writer &) = delete;
+    feature_writer &operator = (const feature_writer &) = delete;
+    ~feature_writer() { close(); }
+
+    bool open(const std::string &path, double sampling_rate);
+    // Columns can be added at any point before close().
+    uint add_column(const column_info &info);
+    // Buffers values of one column; only full chunks are written, so memory
+    // stays at one chunk per column however long the series gets.
+    void append(uint column, const double *vals, size_t n);
+    void append(uint column, double v) { append(column, &v, 1); }
+    void add_scalar(const std::string &name, double v);
+    // Writes the remaining chunks, the directory and the final header; false
+    // if any write failed.
+    bool close();
+
+private:
+    struct chunk_ref {
+        uint64_t offset;
+        uint32_t frames;
+        uint32_t bytes;
+    };
+    struct column {
+        column_info info;
+        std::vector<double> pending;
+        uint64_t frames = 0;
+        std::vector<chunk_ref> chunks;
+    };
+
+    FILE *f = nullptr;
+    bool ok = false;
+    uint64_t pos = 0;
+    double rate = 0.0;
+    std::vector<column> columns;
+    std::vector<std::pair<std::string, double>> scalars;
+    std::vector<uint8_t> packed;
+
+    void write(const void *data, size_t bytes);
+    void flush_chunk(column &col);
+};
+
+// Reads the directory of a feature file and then single columns on request.
+class feature_reader
+{
+public:
+    struct column_desc {
+        feature_writer::column_info info;
+        uint64_t frames;
+    };
+
+    feature_reader() {}
+    feature_reader(const feature_reader &) = delete;
+    feature_reader &operator = (const feature_reader &) = delete;
+    ~feature_reader();
+
+    bool open(const std::string &path);
+    const std::string &error() const { return err; }
+    double sampling_rate() const { return rate; }
+    const std::vector<column_desc> &columns() const { return descs; }
+    const std::vector<std::pair<std::string, double>> &scalars() const { return scalar_vals; }
+    // Index of the column called name, or -1.
+    int find(const std::string &name) const;
+    // Decodes one column, touching only its own chunks.
+    bool read(uint column, std::vector<double> &out);
+
+private:
+    struct chunk_ref {
+        uint64_t offset;
+        uint32_t frames;
+        uint32_t bytes;
+    };
+
+    FILE *f = nullptr;
+    double rate = 0.0;
+    std::vector<column_desc> descs;
+    std::vector<std::vector<chunk_ref>> chunks;
+    std::vector<std::pair<std::string, double>> scalar_vals;
+    std::string err;
+
+    bool fail(const std::string &msg);
+};
+
+// Long-format CSV, one "column,frame,time,value" row per value, with scalars
+// as rows without frame and time. Rows collect in a buffer of at most
+// buffer_bytes before they are written.
+class csv_writer
+{
+public:
+    csv_writer() {}
+    csv_writer(const csv_writer &) = delete;
+    csv_writer &operator = (const csv_writer &) = delete;
+    ~csv_writer() { close(); }
+
+    bool open(const std::string &path, size_t buffer_bytes = 1 << 16);
+    void row(const std::string &column, size_t frame, double time, double value);
+    void scalar(const std::string &name, double value);
+    bool close();
+
+private:
+    FILE *f = nullptr;
+    bool ok = false;
+    size_t limit = 0;
+    std::string buf;
+
+    void add_name(const std::string &name);
+    void flush();
+};
+
+// Every feature series and scalar of every channel of a, with columns named
+// "channel/feature".
+template <typename T>
+bool export_features(basic_audio<T> &a, const std::string &path,
+                     feature_writer::encoding enc = feature_writer::xor_delta);
+template <typename T>
+bool export_csv(basic_audio<T> &a, const std::string &path);
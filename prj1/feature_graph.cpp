@@ -0,0 +1,60 @@
+#include "feature_graph.h"
+
+uint feature_graph::add(const std::string &name, const std::vector<uint> &inputs, compute_fn fn,
+                        const std::map<std::string, double> &params)
+{
+    uint id = nodes.size();
+    nodes.emplace_back();
+    node &n = nodes.back();
+    n.name = name;
+    n.inputs = inputs;
+    n.params = params;
+    n.fn = std::move(fn);
+    for (uint in : inputs)
+        nodes[in].outputs.push_back(id);
+    return id;
+}
+
+int feature_graph::find(const std::string &name) const
+{
+    for (uint i = 0; i < nodes.size(); i++)
+        if (nodes[i].name == name)
+            return i;
+    return -1;
+}
+
+void feature_graph::set_param(uint node, const std::string &key, double value)
+{
+    double &p = nodes[node].params.at(key);
+    if (p == value)
+        return;
+    p = value;
+    invalidate(node);
+}
+
+void feature_graph::invalidate(uint node)
+{
+    std::vector<uint> stack(1, node);
+    while (!stack.empty()) {
+        uint n = stack.back();
+        stack.pop_back();
+        if (nodes[n].dirty && n != node)
+            continue;
+        nodes[n].dirty = true;
+        for (uint out : nodes[n].outputs)
+            stack.push_back(out);
+    }
+}
+
+uint feature_graph::update()
+{
+    uint ran = 0;
+    for (auto &n : nodes) {
+        if (!n.dirty)
+            continue;
+        n.fn();
+        n.dirty = false;
+        ran++;
+    }
+    return ran;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+typedef unsigned int uint;
+
+// Recomputation graph for one channel's features and scalars. Every node
+// lists the nodes it reads and the parameters it uses; changing a parameter
+// marks that node and everything downstream of it, and update() reruns only
+// those. Inputs must be added before the nodes that read them, so insertion
+// order is already a topological order.
+class feature_graph
+{
+public:
+    typedef std::function<void()> compute_fn;
+
+    uint add(const std::string &name, const std::vector<uint> &inputs, compute_fn fn,
+             const std::map<std::string, double> &params = {});
+    // Index of the node called name, or -1.
+    int find(const std::string &name) const;
+    double param(uint node, const std::string &key) const { return nodes[node].params.at(key); }
+    // Invalidates the node only when the value actually changes.
+    void set_param(uint node, const std::string &key, double value);
+    void invalidate(uint node);
+    // For a node whose output was produced outside update(), e.g. while loading.
+    void mark_done(uint node) { nodes[node].dirty = false; }
+    // Recomputes every invalid node in order and returns how many ran.
+    uint update();
+
+    uint size() const { return nodes.size(); }
+    const std::string &name(uint node) const { return nodes[node].name; }
+    const std::map<std::string, double> &params(uint node) const { return nodes[node].params; }
+
+private:
+    struct node {
+        std::string name;
+        std::vector<uint> inputs;
+        std::vector<uint> outputs;
+        std::map<std::string, double> params;
+        compute_fn fn;
+        bool dirty = true;
+    };
+    std::vector<node> nodes;
+};
@@ -0,0 +1,162 @@
+#include "feature_index.h"
+#include <algorithm>
+#include <cmath>
+
+uint feature_index::add_source(const std::string &name, double frame_period)
+{
+    sources.push_back({ name, frame_period, {} });
+    return sources.size() - 1;
+}
+
+void feature_index::add_series(uint s, const std::string &feature, std::vector<double> vals)
+{
+    series &sr = sources[s].features[feature];
+    size_t nb = (vals.size() + block_frames - 1) / block_frames;
+    sr.block_min.assign(nb, INFINITY);
+    sr.block_max.assign(nb, -INFINITY);
+    for (size_t i = 0; i < vals.size(); i++) {
+        if (std::isnan(vals[i]))
+            continue;
+        size_t b = i / block_frames;
+        sr.block_min[b] = std::min(sr.block_min[b], vals[i]);
+        sr.block_max[b] = std::max(sr.block_max[b], vals[i]);
+    }
+    sr.vals = std::move(vals);
+    sorted.erase(feature);
+}
+
+void feature_index::build_sorted(const std::string &feature)
+{
+    std::vector<sorted_entry> &list = sorted[feature];
+    list.clear();
+    for (uint s = 0; s < sources.size(); s++) {
+        auto it = sources[s].features.find(feature);
+        if (it == sources[s].features.end())
+            continue;
+        const std::vector<double> &vals = it->second.vals;
+        for (uint i = 0; i < vals.size(); i++)
+            if (!std::isnan(vals[i]))
+                list.push_back({ vals[i], s, i });
+    }
+    std::sort(list.begin(), list.end(),
+              [](const sorted_entry &a, const sorted_entry &b) { return a.value < b.value; });
+}
+
+bool feature_index::resolve(uint s, const std::vector<predicate> &preds, std::vector<const series *> &cols) const
+{
+    cols.clear();
+    for (auto &p : preds) {
+        auto it = sources[s].features.find(p.feature);
+        if (it == sources[s].features.end() ||
+            (!cols.empty() && it->second.vals.size() != cols[0]->vals.size()))
+            return false;
+        cols.push_back(&it->second);
+    }
+    return true;
+}
+
+static bool matches(const std::vector<feature_index::predicate> &preds, const std::vector<double> *const *vals,
+                    uint frame)
+{
+    for (uint p = 0; p < preds.size(); p++)
+        if (!preds[p].holds((*vals[p])[frame]))
+            return false;
+    return true;
+}
+
+// Takes the frames from the sorted index of the first predicate, if it has
+// one and it selects under an eighth of them, then checks the others per frame.
+bool feature_index::query_sorted(const std::vector<predicate> &preds, std::vector<segment> &out) const
+{
+    auto it = sorted.find(preds[0].feature);
+    if (it == sorted.end())
+        return false;
+
+    // The closed range is a superset; matches() drops the frames on the bounds.
+    const std::vector<sorted_entry> &list = it->second;
+    auto lo = std::lower_bound(list.begin(), list.end(), preds[0].lo,
+                               [](const sorted_entry &e, double v) { return e.value < v; });
+    auto hi = std::upper_bound(lo, list.end(), preds[0].hi,
+                               [](double v, const sorted_entry &e) { return v < e.value; });
+    if (static_cast<size_t>(hi - lo) * 8 > list.size())
+        return false;
+
+    std::vector<std::pair<uint, uint>> frames;
+    frames.reserve(hi - lo);
+    for (auto e = lo; e != hi; ++e)
+        frames.emplace_back(e->source, e->frame);
+    std::sort(frames.begin(), frames.end());
+
+    std::vector<const series *> cols;
+    std::vector<const std::vector<double> *> vals;
+    uint current = ~0u;
+    bool usable = false;
+    for (auto &f : frames) {
+        if (f.first != current) {
+            current = f.first;
+            usable = resolve(current, preds, cols);
+            vals.clear();
+            for (auto c : cols)
+                vals.push_back(&c->vals);
+        }
+        if (!usable || !matches(preds, vals.data(), f.second))
+            continue;
+        if (!out.empty() && out.back().source == f.first && out.back().end == f.second)
+            out.back().end++;
+        else
+            out.push_back({ f.first, f.second, f.second + 1 });
+    }
+    return true;
+}
+
+std::vector<feature_index::segment> feature_index::query(const std::vector<predicate> &preds,
+                                                         query_stats *stats) const
+{
+    std::vector<segment> out;
+    query_stats local;
+    query_stats &st = stats ? *stats : local;
+    st = query_stats();
+    if (preds.empty())
+        return out;
+    if (query_sorted(preds, out)) {
+        st.used_sorted = true;
+        return out;
+    }
+
+    std::vector<const series *> cols;
+    std::vector<const std::vector<double> *> vals;
+    for (uint s = 0; s < sources.size(); s++) {
+        if (!resolve(s, preds, cols))
+            continue;
+        vals.clear();
+        for (auto c : cols)
+            vals.push_back(&c->vals);
+
+        size_t n = cols[0]->vals.size();
+        bool open = false;
+        for (size_t b = 0; b < cols[0]->block_min.size(); b++) {
+            st.blocks++;
+            bool possible = true;
+            for (uint p = 0; p < preds.size() && possible; p++)
+                possible = cols[p]->block_max[b] >= preds[p].lo && cols[p]->block_min[b] <= preds[p].hi;
+            if (!possible) {
+                open = false;
+                continue;
+            }
+
+            st.scanned++;
+            uint end = std::min<size_t>(n, (b + 1) * block_frames);
+            for (uint i = b * block_frames; i < end; i++) {
+                if (!matches(preds, vals.data(), i)) {
+                    open = false;
+                } else if (open) {
+                    out.back().end = i + 1;
+                } else {
+                    out.push_back({ s, i, i + 1 });
+                    open = true;
+                }
+            }
+        }
+    }
+    return out;
+}
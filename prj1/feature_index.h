@@ -0,0 +1,75 @@
+#pragma once
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+typedef unsigned int uint;
+
+// Frame-level index over the feature series of many analysed sources (one
+// file channel each). Every series is cut into blocks of block_frames frames
+// that keep their min/max (a zone map), so range and conjunction queries only
+// scan blocks whose range can match. A sorted index can be added per feature
+// for very selective single-feature lookups.
+class feature_index
+{
+public:
+    static constexpr uint block_frames = 64;
+
+    // lo < value < hi, as written in a query; an infinite bound leaves that
+    // side open. NaN (gated) frames never match.
+    struct predicate {
+        std::string feature;
+        double lo;
+        double hi;
+
+        bool holds(double v) const
+        {
+            return !std::isnan(v) && (v > lo || lo == -INFINITY) && (v < hi || hi == INFINITY);
+        }
+    };
+    // Frames [first, end) of one source where every predicate holds.
+    struct segment {
+        uint source;
+        uint first;
+        uint end;
+    };
+    struct query_stats {
+        size_t blocks = 0;
+        size_t scanned = 0;
+        bool used_sorted = false;
+    };
+
+    uint add_source(const std::string &name, double frame_period);
+    void add_series(uint source, const std::string &feature, std::vector<double> vals);
+    void build_sorted(const std::string &feature);
+
+    // All predicates must refer to series of the same length in a source;
+    // sources where they do not are skipped.
+    std::vector<segment> query(const std::vector<predicate> &preds, query_stats *stats = nullptr) const;
+
+    uint num_sources() const { return sources.size(); }
+    const std::string &source_name(uint s) const { return sources[s].name; }
+    double frame_period(uint s) const { return sources[s].period; }
+
+private:
+    struct series {
+        std::vector<double> vals;
+        std::vector<double> block_min;
+        std::vector<double> block_max;
+    };
+    struct source {
+        std::string name;
+        double period;
+        std::map<std::string, series> features;
+    };
+    struct sorted_entry {
+        double value;
+        uint source;
+        uint frame;
+    };
+    std::vector<source> sources;
+    std::map<std::string, std::vector<sorted_entry>> sorted;
+
+    bool resolve(uint s, const std::vector<predicate> &preds, std::vector<const series *> &cols) const;
+    bool query_sorted(const std::vector<predicate> &preds, std::vector<segment> &out) const;
+};
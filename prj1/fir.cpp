@@ -0,0 +1,118 @@
+#include "fir.h"
+#include <algorithm>
+#include <cmath>
+
+// Low-pass with unit DC gain, cutoff as a fraction of the sampling rate.
+static std::vector<double> windowed_sinc(double cutoff, uint n)
+{
+    std::vector<double> h(n);
+    double sum = 0.0;
+    for (uint i = 0; i < n; i++) {
+        double x = static_cast<double>(i) - (n - 1) / 2.0;
+        double sinc = x == 0.0 ? 2.0 * cutoff : sin(2.0 * M_PI * cutoff * x) / (M_PI * x);
+        double blackman = 0.42 - 0.5 * cos(2.0 * M_PI * i / (n - 1)) + 0.08 * cos(4.0 * M_PI * i / (n - 1));
+        h[i] = sinc * blackman;
+        sum += h[i];
+    }
+    for (auto &v : h)
+        v /= sum;
+    return h;
+}
+
+fir_filter::fir_filter(const filter_spec &spec, double fs)
+{
+    uint n = std::max(3u, spec.taps | 1);
+    double nyquist = fs / 2.0;
+    double low = std::min(std::max(spec.low_hz, 1.0), nyquist) / fs;
+    double high = std::min(std::max(spec.high_hz, 1.0), nyquist) / fs;
+    switch (spec.type) {
+    case filter_spec::lowpass:
+        h = windowed_sinc(high, n);
+        break;
+    case filter_spec::highpass:
+        h = windowed_sinc(low, n);
+        for (auto &v : h)
+            v = -v;
+        h[n / 2] += 1.0;
+        break;
+    case filter_spec::bandpass: {
+        h = windowed_sinc(high, n);
+        std::vector<double> below = windowed_sinc(std::min(low, high), n);
+        for (uint i = 0; i < n; i++)
+            h[i] -= below[i];
+        break;
+    }
+    case filter_spec::preemphasis:
+        h = { 1.0, -spec.emphasis };
+        return;
+    default:
+        return;
+    }
+    delay = (n - 1) / 2;
+
+    block = next_pow2(4 * h.size());
+    spectrum.assign(block, 0.0);
+    std::copy(h.begin(), h.end(), spectrum.begin());
+    fft_radix2(spectrum.data(), block);
+}
+
+template <typename T>
+static inline T to_sample(double v)
+{
+    return static_cast<T>(v);
+}
+
+template <>
+inline int16_t to_sample<int16_t>(double v)
+{
+    return static_cast<int16_t>(std::max(-32768.0, std::min(32767.0, round(v))));
+}
+
+template <typename T>
+void fir_filter::process(pcm_view<T> src, size_t first, size_t end, T *out) const
+{
+    long taps = h.size(), ns = src.size();
+    auto at = [&](long i) { return i >= 0 && i < ns ? static_cast<double>(src[i]) : 0.0; };
+
+    if (h.size() <= direct_max_taps) {
+        for (size_t i = first; i < end; i++) {
+            double acc = 0.0;
+            for (long k = 0; k < taps; k++)
+                acc += h[k] * at(static_cast<long>(i) + delay - k);
+            out[i] = to_sample<T>(acc);
+        }
+        return;
+    }
+
+    // Overlap-save: a block of inputs starting taps - 1 before its outputs
+    // leaves `step` outputs that saw every tap. h is real, so a second block
+    // rides along in the imaginary part and comes back there. Block pairs sit
+    // on a fixed grid, so an output does not depend on how the range was cut.
+    size_t step = block - taps + 1;
+    std::vector<dcomplex> x(block);
+    for (size_t o = first / (2 * step) * (2 * step); o < end; o += 2 * step) {
+        long base = static_cast<long>(o) + delay - (taps - 1);
+        for (size_t j = 0; j < block; j++)
+            x[j] = dcomplex(at(base + j), at(base + step + j));
+        fft_radix2(x.data(), block);
+        for (size_t j = 0; j < block; j++) {
+            double re = x[j].real() * spectrum[j].real() - x[j].imag() * spectrum[j].imag();
+            double im = x[j].real() * spectrum[j].imag() + x[j].imag() * spectrum[j].real();
+            x[j] = dcomplex(re, im);
+        }
+        fft_radix2(x.data(), block, true);
+
+        double scale = 1.0 / block;
+        for (size_t j = 0; j < 2 * step; j++) {
+            size_t i = o + j;
+            if (i < first || i >= end)
+                continue;
+            const dcomplex &y = x[taps - 1 + j % step];
+            out[i] = to_sample<T>((j < step ? y.real() : y.imag()) * scale);
+        }
+    }
+}
+
+template void fir_filter::process(pcm_view<double> src, size_t first, size_t end, double *out) const;
+template void fir_filter::process(pcm_view<float> src, size_t first, size_t end, float *out) const;
+template void fir_filter::process(pcm_view<int16_t> src, size_t first, size_t end, int16_t *out) const;
@@ -0,0 +1,48 @@
+#pragma once
+#include "wav_file.h"
+#include "fft.h"
+#include <vector>
+
+// What to filter the signal with before analysis. Cut-offs are in Hz; taps
+// is rounded up to an odd count so the filter has a whole-sample delay.
+struct filter_spec
+{
+    enum kind { none, lowpass, highpass, bandpass, preemphasis };
+    kind type = none;
+    // High-pass cut-off and lower band-pass edge.
+    double low_hz = 80.0;
+    // Low-pass cut-off and upper band-pass edge.
+    double high_hz = 4000.0;
+    // y[n] = x[n] - a * x[n - 1]
+    double emphasis = 0.97;
+    uint taps = 255;
+};
+
+// Linear-phase FIR filter (Blackman-windowed sinc) designed from a
+// filter_spec. Long filters run as FFT overlap-save, two real blocks per
+// complex transform; short ones (pre-emphasis) directly. The output is
+// shifted back by the filter delay so features stay aligned with the input.
+class fir_filter
+{
+public:
+    fir_filter() {}
+    fir_filter(const filter_spec &spec, double fs);
+    bool empty() const { return h.empty(); }
+    // Input samples past `end` that process() reads: the filter delay, plus
+    // the rest of the last block pair for the FFT path.
+    uint lookahead() const { return delay + (spectrum.empty() ? 0 : 2 * (block - h.size() + 1) - 1); }
+
+    // Output samples [first, end) into out[first..], with zeros outside the
+    // signal. Ranges can be filtered independently, e.g. chunk by chunk or
+    // from several threads, with the same results.
+    template <typename T>
+    void process(pcm_view<T> src, size_t first, size_t end, T *out) const;
+
+private:
+    static constexpr uint direct_max_taps = 32;
+    std::vector<double> h;
+    uint delay = 0;
+    // Transform of h zero-padded to block, for overlap-save.
+    size_t block = 0;
+    std::vector<dcomplex> spectrum;
+};
@@ -0,0 +1,135 @@
+#include "frame_sweep.h"
+#include "trace.h"
+#include <math.h>
+#include <algorithm>
+
+static inline bool is_negative(double v) { return signbit(v); }
+static inline bool is_negative(float v) { return signbit(v); }
+static inline bool is_negative(int16_t v) { return v < 0; }
+
+template <typename T>
+frame_sums<T>::frame_sums(pcm_view<T> src)
+{
+    trace::scope t("frame sums");
+    size_t n = src.size();
+    block_sq.assign(n / block + 1, 0);
+    local_sq.resize(n + 1);
+    crossings.resize(n);
+
+    sum_t total = 0;
+    sum_t local = 0;
+    uint32_t zc = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (i % block == 0) {
+            total += local;
+            block_sq[i / block] = total;
+            local = 0;
+        }
+        local_sq[i] = local;
+        sum_t v = src[i];
+        local += v * v;
+        crossings[i] = zc;
+        if (i + 1 < n)
+            zc += is_negative(src[i]) != is_negative(src[i + 1]);
+    }
+    if (n % block == 0) {
+        block_sq[n / block] = total + local;
+        local_sq[n] = 0;
+    } else {
+        local_sq[n] = local;
+    }
+    trace::count("bytes touched", static_cast<int64_t>(n) * sizeof(T));
+}
+
+template <typename T>
+typename frame_sums<T>::sum_t frame_sums<T>::squares(size_t first, size_t end) const
+{
+    return (block_sq[end / block] - block_sq[first / block]) + (local_sq[end] - local_sq[first]);
+}
+
+template <typename T>
+double frame_sums<T>::volume(size_t offset, uint frame_size) const
+{
+    return sqrt(ste(offset, frame_size));
+}
+
+template <typename T>
+double frame_sums<T>::ste(size_t offset, uint frame_size) const
+{
+    size_t end = std::min(offset + frame_size, size());
+    size_t first = std::min(offset, end);
+    return static_cast<double>(squares(first, end)) / static_cast<double>(end - first) *
+        sample_traits<T>::scale * sample_traits<T>::scale;
+}
+
+template <typename T>
+double frame_sums<T>::zcr(size_t offset, uint frame_size, double fs) const
+{
+    if (offset >= size())
+        return 0.0;
+    size_t pairs = std::min<size_t>(frame_size - 1, size() - 1 - offset);
+    uint32_t sum = crossings[offset + pairs] - crossings[offset];
+    return static_cast<double>(sum) * fs / static_cast<double>(pairs + 1);
+}
+
+const std::vector<std::string> &sweep_features()
+{
+    static const std::vector<std::string> names = { "volume", "STE", "ZCR", "Silence ratio" };
+    return names;
+}
+
+template <typename T>
+std::vector<sweep_result> sweep(pcm_view<T> src, double fs, const std::vector<sweep_point> &grid,
+                                const std::vector<std::string> &features)
+{
+    trace::scope t("sweep");
+    frame_sums<T> sums(src);
+
+    std::vector<sweep_point> points;
+    for (auto &p : grid)
+        if (p.frame_size > 1 && p.overlap < p.frame_size)
+            points.push_back(p);
+    // Positions in sweep_features() of the requested ones.
+    const std::vector<std::string> &known = sweep_features();
+    std::vector<size_t> wanted;
+    for (auto &f : features) {
+        size_t k = std::find(known.begin(), known.end(), f) - known.begin();
+        if (k < known.size())
+            wanted.push_back(k);
+    }
+
+    std::vector<sweep_result> results(points.size() * wanted.size());
+    parallel_for(points.size(), [&](uint p) {
+        uint frame_size = points[p].frame_size;
+        uint stride = frame_size - points[p].overlap;
+        size_t ns = sums.size();
+        uint nf = ns / stride + ((ns % stride > 0) ? 1 : 0);
+
+        sweep_result *out = results.data() + p * wanted.size();
+        for (size_t k = 0; k < wanted.size(); k++)
+            out[k] = { known[wanted[k]], points[p], nf, running_stats() };
+        for (uint i = 0; i < nf; i++) {
+            size_t offset = static_cast<size_t>(i) * stride;
+            double vals[4];
+            vals[1] = sums.ste(offset, frame_size);
+            vals[0] = sqrt(vals[1]);
+            vals[2] = sums.zcr(offset, frame_size, fs);
+            vals[3] = vals[0] < silence_volume ? (vals[2] > 50 ? 0.5 : 1) : 0;
+            for (size_t k = 0; k < wanted.size(); k++)
+                out[k].stats.add(vals[wanted[k]]);
+        }
+        trace::count("frames", nf);
+    });
+    return results;
+}
+
+template class frame_sums<double>;
+template class frame_sums<float>;
+template class frame_sums<int16_t>;
+
+template std::vector<sweep_result> sweep(pcm_view<double> src, double fs, const std::vector<sweep_point> &grid,
+                                         const std::vector<std::string> &features);
+template std::vector<sweep_result> sweep(pcm_view<float> src, double fs, const std::vector<sweep_point> &grid,
+                                         const std::vector<std::string> &features);
+template std::vector<sweep_result> sweep(pcm_view<int16_t> src, double fs, const std::vector<sweep_point> &grid,
+                                         const std::vector<std::string> &features);
@@ -0,0 +1,60 @@
+#pragma once
+#include "audio.h"
+#include <type_traits>
+
+// Running sums over one channel from which volume, STE and ZCR of any frame
+// follow in O(1), so many frame grids can be evaluated after a single pass
+// over the samples. Squares are summed per block of `block` samples on top
+// of the totals before each block, which keeps the error of a short frame
+// relative to its own block rather than to everything before it.
+template <typename T>
+class frame_sums
+{
+public:
+    frame_sums(pcm_view<T> src);
+    size_t size() const { return crossings.size(); }
+
+    // Same values as volume_fun, ste_fun and zcr_fun for the frame at offset.
+    double volume(size_t offset, uint frame_size) const;
+    double ste(size_t offset, uint frame_size) const;
+    double zcr(size_t offset, uint frame_size, double fs) const;
+
+private:
+    static constexpr size_t block = 4096;
+    // Exact for int16, double for the floating point types.
+    typedef typename std::conditional<std::is_integral<typename sample_traits<T>::acc_t>::value,
+                                      int64_t, double>::type sum_t;
+    // Sum of squares of all blocks before block b.
+    std::vector<sum_t> block_sq;
+    // Sum of squares from the start of i's block up to (not including) i, for i <= size().
+    std::vector<sum_t> local_sq;
+    // Sign changes between neighbours j, j + 1 with j < i.
+    std::vector<uint32_t> crossings;
+
+    sum_t squares(size_t first, size_t end) const;
+};
+
+// One frame grid of a sweep.
+struct sweep_point {
+    uint frame_size;
+    uint overlap;
+};
+
+// Summary of one feature series on one grid point, the same as time_params
+// would have collected.
+struct sweep_result {
+    std::string feature;
+    sweep_point grid;
+    uint frames;
+    running_stats stats;
+};
+
+// Features frame_sums can serve, by their frame_fun names.
+const std::vector<std::string> &sweep_features();
+
+// Evaluates the requested features on every grid point of one channel. The
+// sums are built once and shared; grid points run in parallel. Points with
+// overlap >= frame_size are skipped.
+template <typename T>
+std::vector<sweep_result> sweep(pcm_view<T> src, double fs, const std::vector<sweep_point> &grid,
+                                const std::vector<std::string> &features);
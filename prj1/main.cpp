@@ -6,12 +6,227 @@
 #include <SDL.h>
 #include <SDL_image.h>
 #include <imfilebrowser.h>
+#include <filesystem>
+#include <thread>
 #include "audio.h"
+#include "feature_export.h"
+#include "trace.h"
 
 #if !SDL_VERSION_ATLEAST(2,0,17)
 #error This backend requires SDL 2.0.17+ because of SDL_RenderGeometry() function
 #endif
 
+template <typename T>
+static void draw_audio(basic_audio<T> &a, int &channel)
+{
+    ImGui::Text("Loaded (%s, %s, %zu bytes of samples)", sample_traits<T>::name(),
+                a.is_mapped() ? "mapped" : "decoded", a.sample_bytes());
+
+    channel = std::min(channel, static_cast<int>(a.channels.size()) - 1);
+    for (uint c = 0; c < a.channels.size(); c++) {
+        if (c > 0)
+            ImGui::SameLine();
+        ImGui::RadioButton(a.channels[c].name.c_str(), &channel, c);
+    }
+    auto &ch = a.channels[channel];
+
+    trace::scope plot("plot");
+    static ImPlotSubplotFlags flags = ImPlotSubplotFlags_LinkAllX;
+    if (ImPlot::BeginSubplots("Audio", ch.tps.size() + 1, 1, ImVec2(-1,1000), flags)) {
+        
+        if (ImPlot::BeginPlot("Data")) {
+            pcm_view<T> main = a.get_view(channel);
+            ImPlot::PlotLine("0", main.data, a.num_samples() - 2, a.sample_period(), 0, 0, main.stride * sizeof(T));
+            for (auto &tp : ch.tps) {
+                ImPlot::PlotLine(tp.first.c_str(), tp.second.time_vec.data(), tp.second.vals.data(),
+                    tp.second.time_vec.size());
+            }
+        ImPlot::EndPlot();
+        }
+
+        for (auto &tp : ch.tps) {
+            if (ImPlot::BeginPlot(tp.first.c_str())) {
+                ImPlot::PlotLine(tp.first.c_str(), tp.second.time_vec.data(), tp.second.vals.data(),
+                    tp.second.time_vec.size());
+                ImPlot::EndPlot();
+            }
+        }
+
+        ImPlot::EndSubplots();
+    }
+
+    for (auto &tp : ch.tps) {
+        if (tp.second.gated_frames)
+            ImGui::Text("%s: %u of %zu frames skipped as silence", tp.first.c_str(),
+                        tp.second.gated_frames, tp.second.vals.size());
+    }
+
+    for (auto &s : ch.scalar_vals) {
+        ImGui::Text(s.first.c_str()); ImGui::SameLine();
+        ImGui::Text(std::to_string(s.second).c_str());
+    }
+
+    // Written next to the recording, as .features (columnar) and .csv.
+    static int encoding = feature_writer::xor_delta;
+    static std::string exported;
+    const char *encodings[] = { "raw", "xor delta", "float32" };
+    ImGui::Combo("Encoding", &encoding, encodings, 3);
+    ImGui::SameLine();
+    if (ImGui::Button("Export features")) {
+        std::filesystem::path base(a.get_filename());
+        std::string columnar = base.replace_extension(".features").string();
+        std::string csv = base.replace_extension(".csv").string();
+        bool ok = export_features(a, columnar, static_cast<feature_writer::encoding>(encoding)) &&
+            export_csv(a, csv);
+        exported = ok ? "wrote " + columnar + " and " + csv : "cannot write " + columnar + " or " + csv;
+    }
+    ImGui::TextUnformatted(exported.c_str());
+
+    // Re-framing one feature only reruns what depends on it.
+    static int feature = 0;
+    static int grid[2] = { 1200, 20 };
+    static uint recomputed = 0;
+    std::vector<const char *> names;
+    for (auto &tp : ch.tps)
+        names.push_back(tp.first.c_str());
+    feature = std::min(feature, static_cast<int>(names.size()) - 1);
+    ImGui::Combo("Feature", &feature, names.data(), names.size());
+    ImGui::InputInt2("Frame size / overlap", grid);
+    if (ImGui::Button("Recalculate feature"))
+        recomputed = a.set_frame(channel, names[feature], grid[0], grid[1]);
+    if (recomputed) {
+        ImGui::SameLine();
+        ImGui::Text("%u of %u nodes recomputed", recomputed, ch.graph.size());
+    }
+}
+
+template <typename T>
+static void draw_precision(basic_audio<T> &a, std::vector<precision_error> &precision)
+{
+    if (ImGui::Button("Compare with double")) {
+        audio ref;
+        analysis_options ref_opts = a.get_options();
+        ref_opts.workers = 0;
+        ref.init(a.get_filename(), ref_opts);
+        precision = compare_precision(ref, a);
+    }
+
+    if (precision.empty() || !ImGui::BeginTable("Precision", 3, ImGuiTableFlags_Borders))
+        return;
+
+    ImGui::TableSetupColumn("Feature");
+    ImGui::TableSetupColumn("Max abs error");
+    ImGui::TableSetupColumn("Max rel error");
+    ImGui::TableHeadersRow();
+    for (auto &e : precision) {
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn(); ImGui::TextUnformatted(e.name.c_str());
+        ImGui::TableNextColumn(); ImGui::Text("%g", e.max_abs);
+        ImGui::TableNextColumn(); ImGui::Text("%g", e.max_rel);
+    }
+    ImGui::EndTable();
+}
+
+// One open file, analysed as whichever sample type was selected when it was
+// opened. Files stay analysed until closed, so switching between them is free.
+struct open_file
+{
+    audio a;
+    audio_f32 a_f32;
+    audio_i16 a_i16;
+    std::vector<precision_error> precision;
+    std::string label;
+};
+
+template <typename F>
+static void with_audio(open_file &f, F fn)
+{
+    if (f.a.is_loaded())
+        fn(f.a);
+    else if (f.a_f32.is_loaded())
+        fn(f.a_f32);
+    else if (f.a_i16.is_loaded())
+        fn(f.a_i16);
+}
+
+// The samples (feature empty) or one feature series of a channel.
+template <typename T>
+static void plot_series(basic_audio<T> &a, int channel, const std::string &feature)
+{
+    channel = std::min(channel, static_cast<int>(a.channels.size()) - 1);
+    if (feature.empty()) {
+        pcm_view<T> main = a.get_view(channel);
+        ImPlot::PlotLine(a.channels[channel].name.c_str(), main.data, a.num_samples() - 2, a.sample_period(), 0, 0,
+                         main.stride * sizeof(T));
+        return;
+    }
+    auto it = a.channels[channel].tps.find(feature);
+    if (it != a.channels[channel].tps.end())
+        ImPlot::PlotLine(feature.c_str(), it->second.time_vec.data(), it->second.vals.data(),
+                         it->second.time_vec.size());
+}
+
+// The same series of every open file, one row each, on a shared time axis.
+static void draw_compare(std::vector<std::unique_ptr<open_file>> &files, int channel)
+{
+    static int selected = 0;
+    std::vector<std::string> names = { "" };
+    with_audio(*files[0], [&](auto &a) {
+        for (auto &tp : a.channels[0].tps)
+            names.push_back(tp.first);
+    });
+    std::vector<const char *> labels = { "Samples" };
+    for (uint i = 1; i < names.size(); i++)
+        labels.push_back(names[i].c_str());
+    selected = std::min(selected, static_cast<int>(labels.size()) - 1);
+    ImGui::Combo("Compare", &selected, labels.data(), labels.size());
+
+    trace::scope plot("plot compare");
+    if (ImPlot::BeginSubplots("Files", files.size(), 1, ImVec2(-1, 250 * files.size()), ImPlotSubplotFlags_LinkAllX)) {
+        for (auto &f : files) {
+            if (ImPlot::BeginPlot(f->label.c_str())) {
+                with_audio(*f, [&](auto &a) { plot_series(a, channel, names[selected]); });
+                ImPlot::EndPlot();
+            }
+        }
+        ImPlot::EndSubplots();
+    }
+}
+
+// Per-stage timings and counters recorded since the last load.
+static void draw_trace()
+{
+    static std::string status;
+    ImGui::Begin("Trace");
+    bool on = trace::on();
+    if (ImGui::Checkbox("Record", &on))
+        trace::enabled = on;
+    ImGui::SameLine();
+    if (ImGui::Button("Export Chrome trace"))
+        status = trace::write_chrome("trace.json") ? "wrote trace.json" : "cannot write trace.json";
+    ImGui::SameLine();
+    ImGui::TextUnformatted(status.c_str());
+
+    if (ImGui::BeginTable("Stages", 4, ImGuiTableFlags_Borders)) {
+        ImGui::TableSetupColumn("Stage");
+        ImGui::TableSetupColumn("Calls");
+        ImGui::TableSetupColumn("Total ms");
+        ImGui::TableSetupColumn("Max ms");
+        ImGui::TableHeadersRow();
+        for (auto &s : trace::stages()) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn(); ImGui::TextUnformatted(s.name.c_str());
+            ImGui::TableNextColumn(); ImGui::Text("%u", s.calls);
+            ImGui::TableNextColumn(); ImGui::Text("%.2f", s.total_ms);
+            ImGui::TableNextColumn(); ImGui::Text("%.2f", s.max_ms);
+        }
+        ImGui::EndTable();
+    }
+    for (auto &c : trace::counters())
+        ImGui::Text("%s: %lld", c.name.c_str(), static_cast<long long>(c.value));
+    ImGui::End();
+}
+
 // Main code
 int main(int, char**)
 {
@@ -50,10 +265,18 @@ int main(int, char**)
     // Setup Platform/Renderer backends
     ImGui_ImplSDL2_InitForSDLRenderer(window, renderer);
     ImGui_ImplSDLRenderer_Init(renderer);
-    ImGui::FileBrowser fileDialog;
+    ImGui::FileBrowser fileDialog(ImGuiFileBrowserFlags_MultipleSelection);
     fileDialog.SetTitle("title");
     fileDialog.SetTypeFilters({ ".wav" });
-    audio a;
+    std::vector<std::unique_ptr<open_file>> files;
+    int current = 0;
+    bool side_by_side = false;
+    const char *sample_modes[] = { "double", "float32", "int16" };
+    int sample_mode = 0;
+    // Files of the last selection that fell back to AudioFile or failed, and why.
+    std::string load_message;
+    analysis_options opts;
+    int channel = 0;
 
     // Our state
     ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
@@ -89,46 +312,106 @@ int main(int, char**)
                 fileDialog.Open();
             }
 
-            if (a.is_loaded())
-            {
-                ImGui::Text("Loaded");
-
-                static ImPlotSubplotFlags flags = ImPlotSubplotFlags_LinkAllX;
-                if (ImPlot::BeginSubplots("Audio", a.tps.size() + 1, 1, ImVec2(-1,1000), flags)) {
-                    
-                    if (ImPlot::BeginPlot("Data")) {
-                        ImPlot::PlotLine("0", a.get_time_vec().data(), a.get_main_vec().data(), a.num_samples() - 2, 0, 1 * sizeof(double));
-                        for (auto &tp : a.tps) {
-                            ImPlot::PlotLine(tp.first.c_str(), tp.second.time_vec.data(), tp.second.vals.data(),
-                                tp.second.time_vec.size());
-                        }
-                    ImPlot::EndPlot();
-                    }
-
-                    for (auto &tp : a.tps) {
-                        if (ImPlot::BeginPlot(tp.first.c_str())) {
-                            ImPlot::PlotLine(tp.first.c_str(), tp.second.time_vec.data(), tp.second.vals.data(),
-                                tp.second.time_vec.size());
-                            ImPlot::EndPlot();
-                        }
-                    }
-
-                    ImPlot::EndSubplots();
+            if (!load_message.empty())
+                ImGui::TextWrapped("%s", load_message.c_str());
+            ImGui::Combo("Samples", &sample_mode, sample_modes, IM_ARRAYSIZE(sample_modes));
+
+            ImGui::Checkbox("Mid/side", &opts.mid_side); ImGui::SameLine();
+            ImGui::Checkbox("Downmix", &opts.downmix); ImGui::SameLine();
+            ImGui::Checkbox("Skip pitch on silence", &opts.gate_silence); ImGui::SameLine();
+            ImGui::Checkbox("Adaptive silence", &opts.adaptive_silence); ImGui::SameLine();
+            ImGui::Checkbox("Pipelined load", &opts.pipelined);
+
+            static const char *filter_types[] = { "none", "low-pass", "high-pass", "band-pass", "pre-emphasis" };
+            int filter_type = opts.filter.type;
+            ImGui::Combo("Filter", &filter_type, filter_types, IM_ARRAYSIZE(filter_types));
+            opts.filter.type = static_cast<filter_spec::kind>(filter_type);
+            if (opts.filter.type == filter_spec::highpass || opts.filter.type == filter_spec::bandpass) {
+                ImGui::SameLine();
+                ImGui::InputDouble("Low (Hz)", &opts.filter.low_hz);
+            }
+            if (opts.filter.type == filter_spec::lowpass || opts.filter.type == filter_spec::bandpass) {
+                ImGui::SameLine();
+                ImGui::InputDouble("High (Hz)", &opts.filter.high_hz);
+            }
+            if (opts.filter.type == filter_spec::preemphasis) {
+                ImGui::SameLine();
+                ImGui::InputDouble("Coefficient", &opts.filter.emphasis);
+            }
+
+            for (uint i = 0; i < files.size(); i++) {
+                if (i > 0)
+                    ImGui::SameLine();
+                ImGui::RadioButton((files[i]->label + "##" + std::to_string(i)).c_str(), &current, i);
+            }
+            if (!files.empty()) {
+                ImGui::SameLine();
+                if (ImGui::Button("Close")) {
+                    files.erase(files.begin() + current);
+                    current = std::max(0, std::min(current, static_cast<int>(files.size()) - 1));
                 }
+                ImGui::SameLine();
+                ImGui::Checkbox("Side by side", &side_by_side);
+            }
 
-                for (auto &s : a.scalar_vals) {
-                    ImGui::Text(s.first.c_str()); ImGui::SameLine();
-                    ImGui::Text(std::to_string(s.second).c_str());
+            if (!files.empty() && side_by_side) {
+                draw_compare(files, channel);
+            } else if (!files.empty()) {
+                open_file &f = *files[current];
+                if (f.a.is_loaded())
+                    draw_audio(f.a, channel);
+                if (f.a_f32.is_loaded()) {
+                    draw_audio(f.a_f32, channel);
+                    draw_precision(f.a_f32, f.precision);
+                }
+                if (f.a_i16.is_loaded()) {
+                    draw_audio(f.a_i16, channel);
+                    draw_precision(f.a_i16, f.precision);
                 }
             }
             ImGui::End();
         }
+        draw_trace();
 
         fileDialog.Display();
         if (fileDialog.HasSelected())
         {
-            std::cout << "Loading " << fileDialog.GetSelected().string() << "\n";
-            a.init(fileDialog.GetSelected().string());
+            // The selected files are analysed side by side, each with an equal
+            // share of the cores for its own pipeline.
+            std::vector<std::filesystem::path> selected = fileDialog.GetMultiSelected();
+            size_t first = files.size();
+            for (auto &path : selected) {
+                std::cout << "Loading " << path.string() << "\n";
+                files.push_back(std::make_unique<open_file>());
+                files.back()->label = path.filename().string();
+            }
+            trace::clear();
+            uint cores = std::max(1u, std::thread::hardware_concurrency());
+            uint side = std::min(static_cast<uint>(selected.size()), cores);
+            analysis_options load_opts = opts;
+            load_opts.workers = std::max(1u, cores / side);
+            parallel_for(selected.size(), [&](uint i) {
+                open_file &f = *files[first + i];
+                if (sample_mode == 1)
+                    f.a_f32.init(selected[i].string(), load_opts);
+                else if (sample_mode == 2)
+                    f.a_i16.init(selected[i].string(), load_opts);
+                else
+                    f.a.init(selected[i].string(), load_opts);
+            }, side);
+            load_message.clear();
+            for (size_t i = first; i < files.size(); i++) {
+                open_file &f = *files[i];
+                const std::string &err = sample_mode == 1 ? f.a_f32.error() : sample_mode == 2 ? f.a_i16.error()
+                                                                                               : f.a.error();
+                if (!err.empty())
+                    load_message += f.label + ": " + err + "\n";
+            }
+            files.erase(std::remove_if(files.begin() + first, files.end(),
+                                       [](const std::unique_ptr<open_file> &f) {
+                                           return !f->a.is_loaded() && !f->a_f32.is_loaded() && !f->a_i16.is_loaded();
+                                       }), files.end());
+            current = std::max(0, static_cast<int>(files.size()) - 1);
             fileDialog.ClearSelected();
         }
 
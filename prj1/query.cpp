@@ -0,0 +1,182 @@
+// Analyses a set of files once, indexes every frame series and answers frame
+// queries read from stdin, one per line, e.g.
+//   ./sound_query -s recordings/*.wav
+//   ZCR>3000, volume<0.02
+//   80<Fundamental frequency<250
+#include "audio.h"
+#include "feature_index.h"
+#include <chrono>
+#include <cstring>
+#include <stdio.h>
+#include <thread>
+
+typedef std::chrono::steady_clock query_clock;
+
+// Analysed series of one file channel, collected before they enter the index.
+struct source_series {
+    std::string name;
+    double period;
+    std::vector<std::pair<std::string, std::vector<double>>> features;
+};
+
+static std::string trim(const std::string &s)
+{
+    size_t first = s.find_first_not_of(" \t");
+    size_t last = s.find_last_not_of(" \t\r\n");
+    return first == std::string::npos ? "" : s.substr(first, last - first + 1);
+}
+
+static bool parse_number(const std::string &s, double &v)
+{
+    char *end;
+    v = strtod(s.c_str(), &end);
+    return !s.empty() && *end == '\0';
+}
+
+// "name<v", "name>v", "v<name", "v>name" or "lo<name<hi".
+static bool parse_predicate(const std::string &text, feature_index::predicate &p)
+{
+    std::vector<std::string> parts;
+    std::vector<char> ops;
+    size_t start = 0;
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] == '<' || text[i] == '>') {
+            parts.push_back(trim(text.substr(start, i - start)));
+            ops.push_back(text[i]);
+            start = i + 1;
+        }
+    }
+    parts.push_back(trim(text.substr(start)));
+
+    p.lo = -INFINITY;
+    p.hi = INFINITY;
+    double a, b;
+    if (parts.size() == 3 && ops[0] == '<' && ops[1] == '<' && parse_number(parts[0], a) &&
+        parse_number(parts[2], b)) {
+        p.feature = parts[1];
+        p.lo = a;
+        p.hi = b;
+        return true;
+    }
+    if (parts.size() != 2)
+        return false;
+    if (parse_number(parts[1], b)) {
+        p.feature = parts[0];
+        (ops[0] == '<' ? p.hi : p.lo) = b;
+        return true;
+    }
+    if (parse_number(parts[0], a)) {
+        p.feature = parts[1];
+        (ops[0] == '<' ? p.lo : p.hi) = a;
+        return true;
+    }
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    bool build_sorted = false;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-s"))
+            build_sorted = true;
+        else
+            files.push_back(argv[i]);
+    }
+    if (files.empty()) {
+        fprintf(stderr, "usage: sound_query [-s] files...\n"
+                        "  -s  also build sorted indexes for very selective queries\n"
+                        "then one query per line on stdin, e.g. \"ZCR>3000, volume<0.02\"\n");
+        return 1;
+    }
+
+    auto start = query_clock::now();
+    std::vector<std::vector<source_series>> analysed(files.size());
+    // Files are analysed side by side, each with an equal share of the cores.
+    uint cores = std::max(1u, std::thread::hardware_concurrency());
+    uint side = std::min(static_cast<uint>(files.size()), cores);
+    analysis_options opts;
+    opts.workers = std::max(1u, cores / side);
+    parallel_for(files.size(), [&](uint f) {
+        audio a;
+        a.init(files[f], opts);
+        for (auto &ch : a.channels) {
+            analysed[f].push_back({ files[f] + " [" + ch.name + "]", 0.0, {} });
+            source_series &src = analysed[f].back();
+            for (auto &tp : ch.tps) {
+                const std::vector<double> &t = tp.second.time_vec;
+                src.period = t.size() > 1 ? t[1] - t[0] : 0.0;
+                src.features.emplace_back(tp.first, tp.second.vals);
+            }
+        }
+    }, side);
+
+    feature_index index;
+    std::vector<std::string> names;
+    for (auto &file : analysed) {
+        for (auto &src : file) {
+            uint id = index.add_source(src.name, src.period);
+            for (auto &f : src.features) {
+                if (std::find(names.begin(), names.end(), f.first) == names.end())
+                    names.push_back(f.first);
+                index.add_series(id, f.first, std::move(f.second));
+            }
+        }
+    }
+    analysed.clear();
+    if (build_sorted)
+        for (auto &n : names)
+            index.build_sorted(n);
+
+    fprintf(stderr, "indexed %u sources in %.1f s; features:", index.num_sources(),
+            std::chrono::duration<double>(query_clock::now() - start).count());
+    for (auto &n : names)
+        fprintf(stderr, " \"%s\"", n.c_str());
+    fprintf(stderr, "\n");
+
+    char line[1024];
+    while (fgets(line, sizeof(line), stdin)) {
+        std::vector<feature_index::predicate> preds;
+        bool ok = true;
+        std::string text = line;
+        size_t pos = 0;
+        while (ok && pos <= text.size()) {
+            size_t comma = text.find(',', pos);
+            if (comma == std::string::npos)
+                comma = text.size();
+            std::string part = trim(text.substr(pos, comma - pos));
+            if (!part.empty()) {
+                preds.emplace_back();
+                ok = parse_predicate(part, preds.back());
+            }
+            pos = comma + 1;
+        }
+        if (!ok || preds.empty()) {
+            fprintf(stderr, "cannot parse: %s", line);
+            continue;
+        }
+
+        feature_index::query_stats stats;
+        auto q_start = query_clock::now();
+        std::vector<feature_index::segment> found = index.query(preds, &stats);
+        double ms = std::chrono::duration<double, std::milli>(query_clock::now() - q_start).count();
+
+        size_t frames = 0;
+        for (uint i = 0; i < found.size(); i++) {
+            const feature_index::segment &s = found[i];
+            frames += s.end - s.first;
+            if (i < 20) {
+                double period = index.frame_period(s.source);
+                printf("%s\t%.3f\t%.3f\n", index.source_name(s.source).c_str(), s.first * period,
+                       (s.end - 1) * period);
+            }
+        }
+        if (found.size() > 20)
+            printf("... %zu more segments\n", found.size() - 20);
+        printf("%zu segments, %zu frames, %.3f ms, %s\n", found.size(), frames, ms,
+               stats.used_sorted ? "sorted index" :
+               ("scanned " + std::to_string(stats.scanned) + " of " + std::to_string(stats.blocks) + " blocks").c_str());
+    }
+
+    return 0;
+}
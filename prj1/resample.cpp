@@ -0,0 +1,92 @@
+#include "resample.h"
+#include <cmath>
+#include <algorithm>
+#include <memory>
+
+decimator::decimator(uint factor, uint taps_per_phase)
+    : m(std::max(1u, factor)), taps(taps_per_phase)
+{
+    uint n = m * taps;
+    double cutoff = 0.45 / m;
+    std::vector<double> h(n);
+    double sum = 0.0;
+    for (uint i = 0; i < n; i++) {
+        double x = static_cast<double>(i) - (n - 1) / 2.0;
+        double sinc = x == 0.0 ? 2.0 * cutoff : sin(2.0 * M_PI * cutoff * x) / (M_PI * x);
+        double blackman = 0.42 - 0.5 * cos(2.0 * M_PI * i / (n - 1)) + 0.08 * cos(4.0 * M_PI * i / (n - 1));
+        h[i] = n > 1 ? sinc * blackman : 1.0;
+        sum += h[i];
+    }
+
+    phases.assign(m, std::vector<double>(taps));
+    for (uint i = 0; i < n; i++)
+        phases[i % m][i / m] = h[i] / sum;
+}
+
+const decimator &decimator::shared(uint factor)
+{
+    static std::mutex mtx;
+    static std::map<uint, std::unique_ptr<decimator>> cache;
+
+    std::lock_guard<std::mutex> lock(mtx);
+    std::unique_ptr<decimator> &d = cache[factor];
+    if (!d)
+        d = std::make_unique<decimator>(factor);
+    return *d;
+}
+
+template <typename T>
+static inline T to_sample(double v)
+{
+    return static_cast<T>(v);
+}
+
+template <>
+inline int16_t to_sample<int16_t>(double v)
+{
+    return static_cast<int16_t>(std::max(-32768.0, std::min(32767.0, round(v))));
+}
+
+template <typename T>
+std::vector<T> decimator::process(pcm_view<T> src) const
+{
+    std::vector<T> out((src.size() + m - 1) / m);
+    process(src, 0, out.size(), out.data());
+    return out;
+}
+
+template <typename T>
+void decimator::process(pcm_view<T> src, size_t first, size_t end, T *out) const
+{
+    // Centre the filter so the output is not delayed relative to the input.
+    long delay = static_cast<long>(m * taps - 1) / 2;
+
+    for (size_t k = first; k < end; k++) {
+        long base = static_cast<long>(k * m) + delay;
+        double acc = 0.0;
+        for (uint p = 0; p < m; p++) {
+            const std::vector<double> &e = phases[p];
+            for (uint j = 0; j < taps; j++) {
+                long idx = base - static_cast<long>(j * m + p);
+                if (idx >= 0 && idx < static_cast<long>(src.size()))
+                    acc += e[j] * src[idx];
+            }
+        }
+        out[k] = to_sample<T>(acc);
+    }
+}
+
+uint pitch_decimation(double fs, double min_rate)
+{
+    uint factor = 1;
+    while (fs / (factor * 2) >= min_rate && factor < 8)
+        factor *= 2;
+    return factor;
+}
+
+template std::vector<double> decimator::process(pcm_view<double> src) const;
+template std::vector<float> decimator::process(pcm_view<float> src) const;
+template std::vector<int16_t> decimator::process(pcm_view<int16_t> src) const;
+template void decimator::process(pcm_view<double> src, size_t first, size_t end, double *out) const;
+template void decimator::process(pcm_view<float> src, size_t first, size_t end, float *out) const;
+template void decimator::process(pcm_view<int16_t> src, size_t first, size_t end, int16_t *out) const;
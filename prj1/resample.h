@@ -0,0 +1,83 @@
+#pragma once
+#include "wav_file.h"
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+// Anti-aliased integer decimation. The windowed-sinc low-pass is split into
+// `factor` polyphase components so only the kept output samples are computed.
+class decimator
+{
+public:
+    decimator(uint factor, uint taps_per_phase = 12);
+    // The filter for factor with the default taps, built once and shared by
+    // every file and thread.
+    static const decimator &shared(uint factor);
+    uint factor() const { return m; }
+
+    // Input samples past the last one an output sample reads.
+    uint lookahead() const { return m * taps; }
+
+    template <typename T>
+    std::vector<T> process(pcm_view<T> src) const;
+    // Output samples [first, end) into out[first..], for filling a signal chunk by chunk.
+    template <typename T>
+    void process(pcm_view<T> src, size_t first, size_t end, T *out) const;
+
+private:
+    uint m;
+    uint taps;
+    // phases[p][j] = h[j * m + p]
+    std::vector<std::vector<double>> phases;
+};
+
+// Decimated copies of channel views, shared by every feature that asks for
+// the same (signal, factor). Safe to use from the per-channel workers.
+template <typename T>
+class decimation_cache
+{
+public:
+    const std::vector<T> &get(pcm_view<T> src, uint factor)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto key = std::make_tuple(src.data, src.stride, factor);
+        auto it = signals.find(key);
+        if (it == signals.end())
+            it = signals.emplace(key, decimator::shared(factor).process(src)).first;
+        return it->second;
+    }
+
+    // Sized but unfilled entry for a caller that decimates src itself, chunk by
+    // chunk; get() must not read a chunk before it has been written.
+    std::vector<T> &reserve(pcm_view<T> src, uint factor)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto key = std::make_tuple(src.data, src.stride, factor);
+        std::vector<T> &v = signals[key];
+        v.assign((src.size() + factor - 1) / factor, T());
+        return v;
+    }
+
+    size_t bytes()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        size_t sum = 0;
+        for (auto &s : signals)
+            sum += s.second.size() * sizeof(T);
+        return sum;
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        signals.clear();
+    }
+
+private:
+    std::mutex mtx;
+    std::map<std::tuple<const T *, uint, uint>, std::vector<T>> signals;
+};
+
+// Largest power-of-two factor that keeps the rate at or above min_rate.
+uint pitch_decimation(double fs, double min_rate = 11025.0);
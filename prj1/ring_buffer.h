@@ -0,0 +1,128 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Single-producer/single-consumer lock-free queue. The capacity is rounded
+// up to a power of two; push() is all-or-nothing so a producer can write
+// whole frames and drop them when the consumer falls behind. push_wait() and
+// pop_wait() sleep instead while the queue is full or empty; the mutex is
+// only taken when one side actually waits.
+template <typename T>
+class ring_buffer
+{
+public:
+    ring_buffer(size_t min_capacity)
+    {
+        size_t cap = 1;
+        while (cap < min_capacity)
+            cap <<= 1;
+        buf.resize(cap);
+        mask = cap - 1;
+    }
+
+    size_t capacity() const { return buf.size(); }
+
+    size_t size() const
+    {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    bool push(const T *items, size_t n)
+    {
+        if (!try_push(items, n))
+            return false;
+        wake();
+        return true;
+    }
+
+    size_t pop(T *items, size_t max_n)
+    {
+        size_t n = try_pop(items, max_n);
+        if (n > 0)
+            wake();
+        return n;
+    }
+
+    void push_wait(const T *items, size_t n)
+    {
+        wait_until([&]() { return try_push(items, n); });
+        wake();
+    }
+
+    // Waits for at least one item.
+    size_t pop_wait(T *items, size_t max_n)
+    {
+        size_t n = 0;
+        wait_until([&]() { return (n = try_pop(items, max_n)) > 0; });
+        wake();
+        return n;
+    }
+
+private:
+    std::vector<T> buf;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head {0};
+    alignas(64) std::atomic<size_t> tail {0};
+    std::atomic<int> waiters {0};
+    std::mutex mtx;
+    std::condition_variable cv;
+
+    bool try_push(const T *items, size_t n)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (buf.size() - (h - tail.load(std::memory_order_acquire)) < n)
+            return false;
+
+        for (size_t i = 0; i < n; i++)
+            buf[(h + i) & mask] = items[i];
+        head.store(h + n, std::memory_order_release);
+        return true;
+    }
+
+    size_t try_pop(T *items, size_t max_n)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t n = head.load(std::memory_order_acquire) - t;
+        if (n > max_n)
+            n = max_n;
+
+        for (size_t i = 0; i < n; i++)
+            items[i] = buf[(t + i) & mask];
+        tail.store(t + n, std::memory_order_release);
+        return n;
+    }
+
+    // A short wait is cheaper spent yielding than sleeping, so a waiter
+    // retries a few times first. It then registers before its last check and
+    // the other side looks for waiters after moving head or tail; the fences
+    // on both sides mean at least one of them sees the other, so no wake-up
+    // is lost.
+    template <typename F>
+    void wait_until(F done)
+    {
+        for (int spin = 0; spin < 64; spin++) {
+            if (done())
+                return;
+            std::this_thread::yield();
+        }
+        std::unique_lock<std::mutex> lock(mtx);
+        waiters.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (!done())
+            cv.wait(lock);
+        waiters.fetch_sub(1);
+    }
+
+    void wake()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_relaxed) > 0) {
+            std::lock_guard<std::mutex> lock(mtx);
+            cv.notify_all();
+        }
+    }
+};
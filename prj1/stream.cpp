@@ -0,0 +1,304 @@
+// Live analysis of raw interleaved S16_LE PCM, e.g.
+//   arecord -f S16_LE -r 44100 -c 1 | ./sound_stream -r 44100 -c 1
+//   ./sound_stream -i /tmp/feed.fifo
+//   ./sound_stream -g 10 -w live.features
+#include "audio.h"
+#include "feature_export.h"
+#include "ring_buffer.h"
+#include <chrono>
+#include <cstring>
+#include <stdio.h>
+#include <thread>
+
+typedef std::chrono::steady_clock stream_clock;
+
+struct stream_options {
+    uint rate = 44100;
+    uint channels = 1;
+    uint frame_size = 1200;
+    uint overlap = 20;
+    uint chunk_frames = 256;
+    double max_latency_ms = 200.0;
+    double generate_s = 0.0;
+    bool paced = false;
+    bool blocking = false;
+    bool adaptive = false;
+    const char *input = nullptr;
+    const char *output = nullptr;
+};
+
+// Marks when the sample count `end` had been received.
+struct arrival {
+    size_t end;
+    stream_clock::time_point time;
+};
+
+struct stream_channel {
+    volume_fun<int16_t> vf;
+    ste_fun<int16_t> sf;
+    zcr_fun<int16_t> zf;
+    sr_fun<int16_t> srf;
+    ff_fun<int16_t> pf;
+    // volume, STE, ZCR, sr, pitch
+    running_stats stats[5];
+    stream_channel(double fs) : zf(fs), srf(fs), pf(fs) {}
+};
+
+static void usage()
+{
+    fprintf(stderr, "usage: sound_stream [-r rate] [-c channels] [-f frame_size] [-o overlap]\n"
+                    "                    [-l max_latency_ms] [-i input | -g seconds] [-p] [-b] [-a] [-w output]\n"
+                    "  -i  raw S16_LE file or FIFO (default stdin)\n"
+                    "  -g  synthesize tone bursts and pauses in real time instead of reading\n"
+                    "  -p  pace a file replay at the sampling rate\n"
+                    "  -b  wait for the analysis instead of dropping input when it falls behind\n"
+                    "  -a  place the silence threshold from the volume percentiles seen so far\n"
+                    "  -w  also write the series to a columnar feature file as they are produced\n");
+}
+
+static bool parse_args(int argc, char **argv, stream_options &opt)
+{
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-p") || !strcmp(argv[i], "-b") || !strcmp(argv[i], "-a")) {
+            (argv[i][1] == 'p' ? opt.paced : argv[i][1] == 'b' ? opt.blocking : opt.adaptive) = true;
+            continue;
+        }
+        if (i + 1 >= argc || argv[i][0] != '-')
+            return false;
+
+        const char *val = argv[++i];
+        switch (argv[i - 1][1]) {
+        case 'r': opt.rate = atoi(val); break;
+        case 'c': opt.channels = atoi(val); break;
+        case 'f': opt.frame_size = atoi(val); break;
+        case 'o': opt.overlap = atoi(val); break;
+        case 'l': opt.max_latency_ms = atof(val); break;
+        case 'g': opt.generate_s = atof(val); break;
+        case 'i': opt.input = val; break;
+        case 'w': opt.output = val; break;
+        default: return false;
+        }
+    }
+
+    return opt.rate > 0 && opt.channels > 0 && opt.frame_size > 1 && opt.overlap < opt.frame_size;
+}
+
+// Fills one chunk of the synthetic source: 220 Hz bursts separated by near silence.
+static void generate(std::vector<int16_t> &chunk, size_t first, const stream_options &opt)
+{
+    static uint32_t noise = 1;
+    for (size_t i = 0; i < chunk.size() / opt.channels; i++) {
+        size_t n = first + i;
+        double t = static_cast<double>(n) / opt.rate;
+        double gain = (n / (opt.rate / 4)) % 3 == 2 ? 0.001 : 0.5;
+        for (uint c = 0; c < opt.channels; c++) {
+            noise = noise * 1103515245u + 12345u;
+            double v = gain * sin(2.0 * M_PI * 220.0 * (c + 1) * t) +
+                0.005 * (static_cast<double>(noise >> 16) / 32768.0 - 1.0);
+            chunk[i * opt.channels + c] = static_cast<int16_t>(lround(v * 32767.0));
+        }
+    }
+}
+
+static void produce(const stream_options &opt, ring_buffer<int16_t> &samples,
+                    ring_buffer<arrival> &marks, std::atomic<bool> &done, std::atomic<size_t> &dropped)
+{
+    FILE *in = stdin;
+    if (opt.input && !(in = fopen(opt.input, "rb"))) {
+        fprintf(stderr, "cannot open %s\n", opt.input);
+        done = true;
+        return;
+    }
+
+    std::vector<int16_t> chunk(opt.chunk_frames * opt.channels);
+    size_t total_frames = static_cast<size_t>(opt.generate_s * opt.rate);
+    size_t produced = 0;
+    size_t pushed = 0;
+    auto start = stream_clock::now();
+
+    while (true) {
+        size_t n;
+        if (opt.generate_s > 0) {
+            n = std::min<size_t>(opt.chunk_frames, total_frames - produced);
+            generate(chunk, produced, opt);
+        } else {
+            n = fread(chunk.data(), sizeof(int16_t) * opt.channels, opt.chunk_frames, in);
+        }
+        if (n == 0)
+            break;
+
+        produced += n;
+        if (opt.generate_s > 0 || opt.paced)
+            std::this_thread::sleep_until(start + std::chrono::duration<double>(
+                static_cast<double>(produced) / opt.rate));
+
+        // A full ring means the analysis is behind: drop input rather than let latency grow.
+        bool queued = samples.push(chunk.data(), n * opt.channels);
+        while (!queued && opt.blocking) {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            queued = samples.push(chunk.data(), n * opt.channels);
+        }
+        if (!queued) {
+            dropped += n;
+            continue;
+        }
+        pushed += n * opt.channels;
+        arrival a = { pushed, stream_clock::now() };
+        while (!marks.push(&a, 1))
+            std::this_thread::yield();
+    }
+
+    if (in != stdin)
+        fclose(in);
+    done = true;
+}
+
+int main(int argc, char **argv)
+{
+    stream_options opt;
+    if (!parse_args(argc, argv, opt)) {
+        usage();
+        return 1;
+    }
+
+    uint nc = opt.channels;
+    uint stride = opt.frame_size - opt.overlap;
+    size_t latency_samples = static_cast<size_t>(opt.max_latency_ms * opt.rate / 1000.0) * nc;
+    ring_buffer<int16_t> samples(std::max<size_t>(latency_samples, 2 * opt.chunk_frames * nc));
+    // Marks are only retired once a whole frame is in, so they must cover the ring and a frame.
+    ring_buffer<arrival> marks((samples.capacity() + opt.frame_size * nc) / (opt.chunk_frames * nc) + 2);
+    std::atomic<bool> done(false);
+    std::atomic<size_t> dropped(0);
+
+    std::thread producer(produce, std::cref(opt), std::ref(samples), std::ref(marks),
+                         std::ref(done), std::ref(dropped));
+
+    std::vector<stream_channel> chans(nc, stream_channel(opt.rate));
+    std::vector<int16_t> frame(opt.frame_size * nc);
+    uint fill = 0;
+    size_t consumed = 0;
+    size_t frame_no = 0;
+    arrival last = { 0, stream_clock::now() };
+    double latency_sum = 0.0;
+    double latency_max = 0.0;
+
+    // volume, STE, ZCR, sr, pitch of each channel
+    feature_writer out;
+    if (opt.output) {
+        if (!out.open(opt.output, opt.rate)) {
+            fprintf(stderr, "cannot write %s\n", opt.output);
+            return 1;
+        }
+        for (uint c = 0; c < nc; c++) {
+            stream_channel &ch = chans[c];
+            frame_fun<int16_t> *funs[5] = { &ch.vf, &ch.sf, &ch.zf, &ch.srf, &ch.pf };
+            for (auto fun : funs) {
+                feature_writer::column_info info;
+                info.name = "ch " + std::to_string(c) + "/" + fun->get_name();
+                info.frame_size = opt.frame_size;
+                info.overlap = opt.overlap;
+                info.step = static_cast<double>(stride) / opt.rate;
+                out.add_column(info);
+            }
+        }
+    }
+
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    printf("time\tchannel\tvolume\tSTE\tZCR\tsilence\tpitch\tlatency_ms\n");
+
+    while (true) {
+        bool finished = done.load();
+        size_t got = samples.pop(frame.data() + fill * nc, (opt.frame_size - fill) * nc);
+        fill += got / nc;
+        consumed += got;
+
+        bool flush = finished && got == 0 && samples.size() == 0 && fill > opt.overlap;
+        if (fill < opt.frame_size && !flush) {
+            if (finished && got == 0 && samples.size() == 0)
+                break;
+            if (got == 0)
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            continue;
+        }
+
+        while (last.end < consumed) {
+            if (marks.pop(&last, 1) == 0)
+                std::this_thread::yield();
+        }
+
+        std::vector<double> vals(5 * nc);
+        for (uint c = 0; c < nc; c++) {
+            pcm_view<int16_t> view(frame.data() + c, fill, nc);
+            stream_channel &ch = chans[c];
+            vals[5 * c + 0] = ch.vf(view, 0, fill);
+            if (opt.adaptive)
+                ch.srf.threshold = adaptive_silence_volume(ch.stats[0]);
+            vals[5 * c + 1] = ch.sf(view, 0, fill);
+            vals[5 * c + 2] = ch.zf(view, 0, fill);
+            vals[5 * c + 3] = ch.srf(view, 0, fill);
+            vals[5 * c + 4] = vals[5 * c] < silence_volume ? NAN : ch.pf(view, 0, fill);
+            for (uint k = 0; k < 5; k++) {
+                ch.stats[k].add(vals[5 * c + k]);
+                if (opt.output)
+                    out.append(5 * c + k, vals[5 * c + k]);
+            }
+        }
+
+        double t = static_cast<double>(frame_no * stride) / opt.rate;
+        double latency = std::chrono::duration<double, std::milli>(stream_clock::now() - last.time).count();
+        for (uint c = 0; c < nc; c++) {
+            double *v = &vals[5 * c];
+            printf("%.4f\t%u\t%g\t%g\t%g\t%g\t%g\t%.3f\n", t, c, v[0], v[1], v[2], v[3], v[4], latency);
+        }
+        latency_sum += latency;
+        latency_max = std::max(latency_max, latency);
+        frame_no++;
+
+        if (flush)
+            break;
+        memmove(frame.data(), frame.data() + stride * nc, opt.overlap * nc * sizeof(int16_t));
+        fill = opt.overlap;
+    }
+
+    producer.join();
+    fprintf(stderr, "%zu frames, latency mean %.3f ms, max %.3f ms, ring %.1f ms, dropped %zu frames\n",
+            frame_no, frame_no ? latency_sum / frame_no : 0.0, latency_max,
+            1000.0 * samples.capacity() / nc / opt.rate, dropped.load());
+
+    // Same file-level scalars as basic_audio::analyze, without keeping the series.
+    deviation_norm_fun dnf;
+    dynamic_range_func drf;
+    low_ratio_fun lrf;
+    deviation_fun df;
+    high_ratio_fun hrf;
+    percentile_range_fun prf;
+    median_fun mf;
+    for (uint c = 0; c < nc; c++) {
+        running_stats *st = chans[c].stats;
+        if (st[0].n == 0)
+            continue;
+        fprintf(stderr, "channel %u: volume %s %g, volume %s %g, STE %s %g, ZCR %s %g, ZCR %s %g\n", c,
+                dnf.get_name().c_str(), dnf(st[0]), drf.get_name().c_str(), drf(st[0]),
+                lrf.get_name().c_str(), lrf(st[1]), df.get_name().c_str(), df(st[2]),
+                hrf.get_name().c_str(), hrf(st[2]));
+        fprintf(stderr, "channel %u: volume %s %g, pitch %s %g, silence threshold %g\n", c,
+                prf.get_name().c_str(), prf(st[0]), mf.get_name().c_str(), mf(st[4]),
+                chans[c].srf.threshold);
+        if (opt.output) {
+            std::string prefix = "ch " + std::to_string(c) + "/";
+            out.add_scalar(prefix + dnf.get_name() + " (volume)", dnf(st[0]));
+            out.add_scalar(prefix + drf.get_name() + " (volume)", drf(st[0]));
+            out.add_scalar(prefix + lrf.get_name() + " (STE)", lrf(st[1]));
+            out.add_scalar(prefix + df.get_name() + " (ZCR)", df(st[2]));
+            out.add_scalar(prefix + hrf.get_name() + " (ZCR)", hrf(st[2]));
+            out.add_scalar(prefix + prf.get_name() + " (volume)", prf(st[0]));
+            out.add_scalar(prefix + mf.get_name() + " (pitch)", mf(st[4]));
+        }
+    }
+    if (opt.output && !out.close()) {
+        fprintf(stderr, "cannot write %s\n", opt.output);
+        return 1;
+    }
+
+    return 0;
+}
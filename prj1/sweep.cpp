@@ -0,0 +1,175 @@
+// Evaluates a grid of frame sizes and overlaps over WAV files in one pass per
+// channel and prints a summary of every feature on every grid point, e.g.
+//   ./sound_sweep -f 400:2400:200 -o 0,20,100 recordings/*.wav > sweep.tsv
+//   ./sound_sweep -t int16 -e volume,ZCR speech.wav
+#include "frame_sweep.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdio.h>
+
+typedef std::chrono::steady_clock sweep_clock;
+
+struct sweep_options {
+    std::vector<uint> frame_sizes = { 600, 900, 1200, 1600, 2400 };
+    std::vector<uint> overlaps = { 0, 20, 300 };
+    std::vector<std::string> features = sweep_features();
+    std::string precision = "double";
+    std::vector<std::string> files;
+};
+
+static void usage()
+{
+    fprintf(stderr, "usage: sound_sweep [-f frame_sizes] [-o overlaps] [-e features]\n"
+                    "                   [-t double|float32|int16] files...\n"
+                    "  -f, -o  comma separated values or first:last:step, in samples\n"
+                    "          (grid points with overlap >= frame size are skipped)\n"
+                    "  -e      comma separated, any of:");
+    for (auto &f : sweep_features())
+        fprintf(stderr, " \"%s\"", f.c_str());
+    fprintf(stderr, "\n");
+}
+
+static std::vector<std::string> split(const std::string &s, char sep)
+{
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (start <= s.size()) {
+        size_t end = s.find(sep, start);
+        if (end == std::string::npos)
+            end = s.size();
+        if (end > start)
+            parts.push_back(s.substr(start, end - start));
+        start = end + 1;
+    }
+    return parts;
+}
+
+// "600,1200,2400" or "400:2400:200".
+static bool parse_values(const std::string &text, std::vector<uint> &out)
+{
+    out.clear();
+    std::vector<std::string> range = split(text, ':');
+    if (range.size() == 3) {
+        long first = atol(range[0].c_str()), last = atol(range[1].c_str()), step = atol(range[2].c_str());
+        if (first < 0 || step <= 0)
+            return false;
+        for (long v = first; v <= last; v += step)
+            out.push_back(v);
+        return !out.empty();
+    }
+    for (auto &v : split(text, ',')) {
+        char *end;
+        long n = strtol(v.c_str(), &end, 10);
+        if (*end != '\0' || n < 0)
+            return false;
+        out.push_back(n);
+    }
+    return !out.empty();
+}
+
+static bool parse_args(int argc, char **argv, sweep_options &opt)
+{
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-') {
+            opt.files.push_back(argv[i]);
+            continue;
+        }
+        if (i + 1 >= argc)
+            return false;
+
+        const char *val = argv[++i];
+        switch (argv[i - 1][1]) {
+        case 'f':
+            if (!parse_values(val, opt.frame_sizes))
+                return false;
+            break;
+        case 'o':
+            if (!parse_values(val, opt.overlaps))
+                return false;
+            break;
+        case 'e':
+            opt.features = split(val, ',');
+            for (auto &f : opt.features) {
+                const std::vector<std::string> &known = sweep_features();
+                if (std::find(known.begin(), known.end(), f) == known.end()) {
+                    fprintf(stderr, "unknown feature \"%s\"\n", f.c_str());
+                    return false;
+                }
+            }
+            break;
+        case 't': opt.precision = val; break;
+        default: return false;
+        }
+    }
+
+    return !opt.files.empty() && !opt.features.empty() &&
+        (opt.precision == "double" || opt.precision == "float32" || opt.precision == "int16");
+}
+
+// Sweeps every channel of one file with samples of type T; returns the number
+// of channels.
+template <typename T>
+static size_t sweep_file(const std::string &path, const std::vector<sweep_point> &grid,
+                         const sweep_options &opt)
+{
+    wav_file wav;
+    if (!wav.open(path)) {
+        fprintf(stderr, "%s: %s\n", path.c_str(), wav.error().c_str());
+        return 0;
+    }
+
+    uint nc = wav.num_channels();
+    std::vector<T> decoded;
+    for (uint c = 0; c < nc; c++) {
+        pcm_view<T> view;
+        if (wav.holds<T>()) {
+            view = wav.channel<T>(c);
+        } else {
+            decoded.resize(wav.num_frames());
+            wav.read(c, 0, decoded.size(), decoded.data());
+            view = pcm_view<T>(decoded);
+        }
+
+        std::string name = nc == 2 ? (c ? "right" : "left") : "ch " + std::to_string(c);
+        for (auto &r : sweep(view, wav.sample_rate(), grid, opt.features)) {
+            const running_stats &s = r.stats;
+            printf("%s\t%s\t%s\t%u\t%u\t%u\t%g\t%g\t%g\t%g\t%g\t%g\t%g\t%g\t%g\n", path.c_str(),
+                   name.c_str(), r.feature.c_str(), r.grid.frame_size, r.grid.overlap, r.frames, s.mean,
+                   s.deviation(), s.min, s.max, s.percentile(0.1), s.percentile(0.5), s.percentile(0.9),
+                   s.low_ratio(), s.high_ratio());
+        }
+    }
+    return nc;
+}
+
+int main(int argc, char **argv)
+{
+    sweep_options opt;
+    if (!parse_args(argc, argv, opt)) {
+        usage();
+        return 1;
+    }
+
+    std::vector<sweep_point> grid;
+    for (uint fs : opt.frame_sizes)
+        for (uint ol : opt.overlaps)
+            if (fs > 1 && ol < fs)
+                grid.push_back({ fs, ol });
+
+    auto start = sweep_clock::now();
+    printf("file\tchannel\tfeature\tframe_size\toverlap\tframes\tmean\tdeviation\tmin\tmax\tp10\tmedian\tp90\tlow ratio\thigh ratio\n");
+    size_t swept = 0;
+    for (auto &path : opt.files) {
+        if (opt.precision == "int16")
+            swept += sweep_file<int16_t>(path, grid, opt);
+        else if (opt.precision == "float32")
+            swept += sweep_file<float>(path, grid, opt);
+        else
+            swept += sweep_file<double>(path, grid, opt);
+    }
+
+    fprintf(stderr, "%zu grid points on %zu channels in %.2f s\n", grid.size(), swept,
+            std::chrono::duration<double>(sweep_clock::now() - start).count());
+    return 0;
+}
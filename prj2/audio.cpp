@@ -2,24 +2,66 @@
 #include <math.h>
 #include "implot.h"
 #include "audio_utils.h"
+#include "mel.h"
+#include "spectrogram.h"
+#include "trace.h"
+#include <chrono>
 
-void audio::init(std::string filename)
+void audio::init(std::string filename, analysis_options opts)
 {
-	af.load(filename);
-	tv.resize(af.getNumSamplesPerChannel());
-	double period = af.getLengthInSeconds() / static_cast<double>(tv.size() - 1);
-	for (uint i = 0; i < tv.size(); i++) {
-		tv[i] = period * static_cast<double>(i);
+	trace::clear();
+	trace::scope load("load");
+	this->opts = opts;
+	channels.clear();
+	derived.clear();
+	af.samples.clear();
+	store.close();
+	shown = 0;
+	spec_shown = -1;
+
+	// Bounded, only the headers are read here; chunks follow on demand.
+	uint nc;
+	if (opts.memory_budget_mb && store.open(filename, static_cast<size_t>(opts.memory_budget_mb) << 20)) {
+		frames = store.num_frames();
+		rate = store.sampling_rate();
+		nc = store.num_channels();
+	} else {
+		af.load(filename);
+		frames = af.getNumSamplesPerChannel();
+		rate = af.getSampleRate();
+		nc = af.samples.size();
 	}
 
-	windowed = std::vector<double>(af.samples[0].begin(), af.samples[0].end());
+	for (uint c = 0; c < nc; c++) {
+		channels.emplace_back();
+		channels.back().name = nc == 2 ? (c ? "right" : "left") : "ch " + std::to_string(c);
+		if (is_bounded()) {
+			channels.back().weights.assign(nc, 0.0);
+			channels.back().weights[c] = 1.0;
+		} else
+			channels.back().samples = &af.samples[c];
+	}
+	add_mixes(opts);
+	if (is_bounded())
+		build_envelopes();
+
+	win_first = 0;
+	win_end = is_bounded() ? std::min(frames, max_window_frames()) : frames;
+	fft_size = next_pow2(win_end);
+	win_coeffs.clear();
 	loaded = true;
 
+	build_params();
+}
+
+void audio::build_params()
+{
 	params.resize(9);
-	param_values = std::vector<double>(params.size(), -2.0);
+	for (auto &ch : channels)
+		ch.param_values = std::vector<double>(params.size(), -2.0);
 	params[0] = std::make_unique<volume_param>();
-	params[1] = std::make_unique<centroid_param>(sampling_freq() / 2.0);
-	params[2] = std::make_unique<effective_bw_param>(sampling_freq() / 2.0);
+	params[1] = std::make_unique<centroid_param>(analysis_freq() / 2.0);
+	params[2] = std::make_unique<effective_bw_param>(analysis_freq() / 2.0);
 	params[3] = std::make_unique<ber_param>(0);
 	params[4] = std::make_unique<ber_param>(1);
 	params[5] = std::make_unique<ber_param>(2);
@@ -29,6 +71,128 @@ void audio::init(std::string filename)
 
 }
 
+// Mid/side and downmix are built in one sweep over the channels, or mixed
+// on every read when bounded.
+void audio::add_mixes(analysis_options opts)
+{
+	uint nc = is_bounded() ? store.num_channels() : af.samples.size();
+	bool mid_side = opts.mid_side && nc == 2;
+	bool downmix = opts.downmix && nc > 1;
+	if (!mid_side && !downmix)
+		return;
+
+	if (is_bounded()) {
+		auto add = [this](std::string name, std::vector<double> weights) {
+			channels.emplace_back();
+			channels.back().name = name;
+			channels.back().weights = weights;
+		};
+		if (mid_side) {
+			add("mid", { 0.5, 0.5 });
+			add("side", { 0.5, -0.5 });
+		}
+		if (downmix)
+			add("downmix", std::vector<double>(nc, 1.0 / nc));
+		return;
+	}
+
+	size_t ns = af.getNumSamplesPerChannel();
+	std::vector<double> mid, side, down;
+	if (mid_side) {
+		mid.resize(ns);
+		side.resize(ns);
+	}
+	if (downmix)
+		down.resize(ns);
+
+	for (size_t i = 0; i < ns; i++) {
+		double sum = 0;
+		for (uint c = 0; c < nc; c++)
+			sum += af.samples[c][i];
+		if (mid_side) {
+			mid[i] = sum * 0.5;
+			side[i] = (af.samples[0][i] - af.samples[1][i]) * 0.5;
+		}
+		if (downmix)
+			down[i] = sum / nc;
+	}
+
+	derived.reserve(3);
+	auto add = [this](std::string name, std::vector<double> &samples) {
+		derived.push_back(std::move(samples));
+		channels.emplace_back();
+		channels.back().name = name;
+		channels.back().samples = &derived.back();
+	};
+	if (mid_side) {
+		add("mid", mid);
+		add("side", side);
+	}
+	if (downmix)
+		add("downmix", down);
+}
+
+// Min/max of every envelope_frames samples, from one pass over the file that
+// bypasses the chunk cache.
+void audio::build_envelopes()
+{
+	trace::scope t("envelopes");
+	size_t entries = (frames + envelope_frames - 1) / envelope_frames;
+	audio_utils::parallel_for(channels.size(), [&](uint c) {
+		channel &ch = channels[c];
+		ch.env_min.resize(entries);
+		ch.env_max.resize(entries);
+		std::vector<double> x(sample_store::chunk_frames);
+		for (size_t first = 0; first < frames; first += x.size()) {
+			size_t n = std::min(x.size(), frames - first);
+			store.scan(ch.weights, first, n, x.data());
+			for (size_t i = 0; i < n; i += envelope_frames) {
+				auto range = std::minmax_element(x.begin() + i, x.begin() + std::min(n, i + envelope_frames));
+				ch.env_min[(first + i) / envelope_frames] = *range.first;
+				ch.env_max[(first + i) / envelope_frames] = *range.second;
+			}
+		}
+	});
+}
+
+// The window copy and its zero-padded complex transform take up to five
+// doubles per frame and channel.
+size_t audio::max_window_frames()
+{
+	return std::max<size_t>(stft_size, store.budget() / (5 * sizeof(double) * std::max<size_t>(1, channels.size())));
+}
+
+// n samples of the channel from first into out, zero past the end.
+void audio::read_channel(channel &ch, size_t first, size_t n, double *out)
+{
+	if (!ch.samples) {
+		store.read(ch.weights, first, n, out);
+		return;
+	}
+	size_t avail = first < ch.samples->size() ? std::min(n, ch.samples->size() - first) : 0;
+	if (avail)
+		std::copy(ch.samples->data() + first, ch.samples->data() + first + avail, out);
+	std::fill(out + avail, out + n, 0.0);
+}
+
+std::vector<double> audio::read_samples(channel &ch, size_t first, size_t end)
+{
+	std::vector<double> out(end - first);
+	read_channel(ch, first, out.size(), out.data());
+	return out;
+}
+
+// The window at the file rate for the STFT: in place, the bounded copy, or read into buf.
+const double *audio::raw_window(channel &ch, std::vector<double> &buf)
+{
+	if (ch.samples)
+		return ch.samples->data() + win_first;
+	if (decimation == 1)
+		return ch.region_copy.data();
+	buf = read_samples(ch, win_first, win_end);
+	return buf.data();
+}
+
 audio::~audio()
 {
 }
@@ -39,48 +203,164 @@ bool audio::is_loaded()
 }
 
 void audio::apply_window(sig_window &win) {
-	uint N = af.getNumSamplesPerChannel();
-	double len = af.getLengthInSeconds();
+	trace::scope t("apply_window");
+	uint N = frames;
+	double len = time_length();
 	uint first_probe = floor(win.start_time * static_cast<double>(N) / len);
 	uint end_probe = ceil(win.end_time * static_cast<double>(N) / len);
 	end_probe = (N > end_probe) ? end_probe : N;
+	first_probe = std::min(first_probe, end_probe);
+	if (is_bounded())
+		end_probe = std::min<size_t>(end_probe, first_probe + max_window_frames());
+
+	win_first = first_probe;
+	win_end = end_probe;
+	// The region stays a view into the samples; decimation and the chunk
+	// cache need a copy.
+	audio_utils::parallel_for(channels.size(), [&](uint c) {
+		channel &ch = channels[c];
+		if (decimation > 1) {
+			ch.region_copy = audio_utils::decimate(read_samples(ch, first_probe, end_probe), decimation);
+			trace::count("allocations", 2);
+			trace::count("bytes touched", (end_probe - first_probe) * sizeof(double));
+		} else if (!ch.samples) {
+			ch.region_copy = read_samples(ch, first_probe, end_probe);
+			trace::count("allocations", 1);
+		} else
+			ch.region_copy.clear();
+	});
+
+	uint n = (end_probe - first_probe + decimation - 1) / decimation;
+	fft_size = next_pow2(n);
+	win_coeffs.clear();
+	if (!win.rect) {
+		win_coeffs.resize(n);
+		for (uint i = 0; i < n; i++)
+			win_coeffs[i] = win.coeff(i, n);
+	}
 
-	std::cout << "Start: " << first_probe << ", End: " << end_probe << "\n";
-	std::cout << "Size: " << N << "\n";
-
-	windowed = std::vector<double>(af.samples[0].begin() + first_probe,
-								   af.samples[0].begin() + end_probe);
-
-	std::cout << "Applying\n";
-	win.apply(windowed);
 	last_win_len = win.end_time - win.start_time;
 	last_win_start = win.start_time;
+	applied.start_time = win.start_time;
+	applied.end_time = win.end_time;
+	applied.rect = win.rect;
+	applied.a0 = win.a0;
+}
+
+bool audio::follow_window(sig_window &win)
+{
+	double now = ImGui::GetTime();
+	if (win.start_time == applied.start_time && win.end_time == applied.end_time &&
+		win.rect == applied.rect && (win.rect || win.a0 == applied.a0)) {
+		if (!details_pending || now - last_update_time < 0.25)
+			return false;
+		update_fft();
+		details_pending = false;
+		return true;
+	}
+
+	// Leave at least one update's worth of idle time between updates.
+	if (now - last_update_time < std::max(1.0 / 60.0, last_update_ms / 1000.0))
+		return false;
+
+	auto start = std::chrono::steady_clock::now();
+	win.update_fun();
+	apply_window(win);
+	update_fft(false);
+	last_update_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	last_update_time = now;
+	details_pending = true;
+	return true;
 }
 
 double audio::sampling_freq()
 {
-	return static_cast<double>(af.getNumSamplesPerChannel()) / af.getLengthInSeconds();
+	return rate;
+}
+
+double audio::analysis_freq()
+{
+	return sampling_freq() / decimation;
+}
+
+void audio::set_decimation(uint factor)
+{
+	decimation = std::max(1u, factor);
+	build_params();
+}
+
+void audio::update_fft(bool details)
+{
+	trace::scope t(details ? "update_fft" : "update_fft (live)");
+	// Large transforms already use every core, so take the channels one at a time.
+	if (fft_size >= audio_utils::fft_four_step_min) {
+		for (auto &ch : channels)
+			channel_fft(ch, details);
+		return;
+	}
+	audio_utils::parallel_for(channels.size(), [&](uint c) { channel_fft(channels[c], details); });
+}
+
+// Analysed part of the channel: the decimated or bounded copy, or the window region in place.
+const double *audio::region(const channel &ch, uint &n) const
+{
+	if (decimation > 1 || !ch.samples) {
+		n = ch.region_copy.size();
+		return ch.region_copy.data();
+	}
+	n = win_end - win_first;
+	return ch.samples->data() + win_first;
 }
 
-void audio::update_fft()
+void audio::channel_fft(channel &ch, bool details)
 {
-	std::valarray<dcomplex> fft(windowed.size());
-	for (uint i = 0; i < windowed.size(); i++) {
-		fft[i] = windowed[i];
+	uint n;
+	const double *x = region(ch, n);
+	const double *w = win_coeffs.size() == n ? win_coeffs.data() : nullptr;
+
+	trace::scope t("fft", ch.name);
+	trace::count("allocations", 1);
+	trace::count("bytes touched", n * sizeof(double));
+
+	// Window while packing, zero-padded up to the power-of-two FFT size.
+	std::valarray<dcomplex> fft(dcomplex(0.0), fft_size);
+	double energy = 0.0;
+	for (uint i = 0; i < n; i++) {
+		double v = w ? x[i] * w[i] : x[i];
+		fft[i] = v;
+		energy += v * v;
 	}
 
 	audio_utils::fft_in_place(fft);
 
-	double max_freq = sampling_freq() / 2.0;
-	uint freq_amp_size = static_cast<uint>(round(windowed.size() * max_freq / sampling_freq()));
-	freq_amp.resize(freq_amp_size);
+	std::vector<double> &freq_amp = ch.freq_amp;
+	freq_amp.resize(fft_size / 2);
 	for (uint i = 0; i < freq_amp.size(); i++) {
-		freq_amp[i] = 2 * pow(abs(fft[i]), 2) / static_cast<double>(windowed.size());
+		freq_amp[i] = 2 * std::norm(fft[i]) / static_cast<double>(n);
+	}
+
+	ch.silent = opts.gate_silence && (n == 0 || sqrt(energy / n) < silence_volume);
+
+	recalc_win_params(ch);
+	if (ch.silent || !details) {
+		ch.cepstrum_freq = NAN;
+		ch.stft_mfcc.clear();
+		ch.stft_frames = 0;
+	}
+	if (ch.silent) {
+		ch.mfcc.assign(mfcc_coeffs, NAN);
+		return;
 	}
 
-	recalc_win_params();
+	const filterbank &fb = filterbank::get(freq_amp.size(), analysis_freq(), mfcc_bands, mfcc_scale);
+	ch.mfcc.resize(mfcc_coeffs);
+	mfcc(fb, freq_amp.data(), mfcc_coeffs, ch.mfcc.data());
+	if (!details)
+		return;
+	stft_mfcc(ch);
 
 	//	Cepstrum nie dziala :(
+	trace::scope cep("cepstrum");
 	audio_utils::cepstrum(fft);
 	std::vector<double> cepstrum_real(fft.size());
 	for (uint i = 0; i < fft.size(); i++)
@@ -88,23 +368,140 @@ void audio::update_fft()
 
 	uint freq_samples = std::max_element(cepstrum_real.begin() + 20, cepstrum_real.begin() + 100)
 		- cepstrum_real.begin();
-	std::cout << "Cepstrum samples: " << freq_samples << ", frequency: "<<
-		sampling_freq() / static_cast<double>(freq_samples) << "\n";
+	ch.cepstrum_freq = analysis_freq() / static_cast<double>(freq_samples);
+}
+
+// MFCCs of stft_size Hann frames over the un-windowed selection at full rate.
+void audio::stft_mfcc(channel &ch)
+{
+	trace::scope t("stft_mfcc", ch.name);
+	uint n = win_end > win_first ? win_end - win_first : 0;
+	ch.stft_frames = n >= stft_size ? (n - stft_size) / stft_hop + 1 : 0;
+	ch.stft_mfcc.assign(mfcc_coeffs * ch.stft_frames, NAN);
+
+	const filterbank &fb = filterbank::get(stft_size / 2, sampling_freq(), mfcc_bands, mfcc_scale);
+	std::valarray<dcomplex> fft(stft_size);
+	std::vector<double> power(stft_size / 2);
+	std::vector<double> coeffs(mfcc_coeffs);
+	std::vector<double> buf;
+	const double *window = raw_window(ch, buf);
+
+	for (uint f = 0; f < ch.stft_frames; f++) {
+		const double *x = window + f * stft_hop;
+		double energy = 0.0;
+		for (uint i = 0; i < stft_size; i++) {
+			energy += x[i] * x[i];
+			fft[i] = x[i] * (0.5 - 0.5 * cos(2.0 * M_PI * i / stft_size));
+		}
+		if (opts.gate_silence && sqrt(energy / stft_size) < silence_volume)
+			continue;
+
+		audio_utils::fft_in_place(fft);
+		trace::count("frames", 1);
+		for (uint k = 0; k < power.size(); k++)
+			power[k] = 2 * std::norm(fft[k]) / stft_size;
+
+		mfcc(fb, power.data(), mfcc_coeffs, coeffs.data());
+		for (uint k = 0; k < mfcc_coeffs; k++)
+			ch.stft_mfcc[k * ch.stft_frames + f] = coeffs[k];
+	}
+}
+
+void audio::draw_mfcc()
+{
+	channel &ch = channels[shown];
+	int bark = mfcc_scale == filterbank::bark;
+	ImGui::RadioButton("mel", &bark, 0); ImGui::SameLine();
+	ImGui::RadioButton("bark", &bark, 1);
+	mfcc_scale = bark ? filterbank::bark : filterbank::mel;
+
+	if (ch.mfcc.empty() || !ImPlot::BeginPlot("MFCC"))
+		return;
+	ImPlot::PlotBars("Window", ch.mfcc.data(), ch.mfcc.size());
+	ImPlot::EndPlot();
+
+	if (ch.stft_frames && ImPlot::BeginPlot("MFCC per STFT frame")) {
+		double t0 = win_first / sampling_freq();
+		double t1 = t0 + (ch.stft_frames * stft_hop) / sampling_freq();
+		ImPlot::PlotHeatmap("MFCC", ch.stft_mfcc.data(), mfcc_coeffs, ch.stft_frames, 0, 0, nullptr,
+							ImPlotPoint(t0, 0), ImPlotPoint(t1, mfcc_coeffs));
+		ImPlot::EndPlot();
+	}
+}
+
+void audio::draw_spectrogram(spectrogram &spec)
+{
+	if (shown != spec_shown) {
+		// The spectrogram sweeps the whole file once, so when bounded it
+		// reads past the chunk cache instead of flushing it.
+		channel &ch = channels[shown];
+		if (ch.samples)
+			spec.set_source([this, &ch](size_t first, size_t n, double *out) { read_channel(ch, first, n, out); },
+							frames, sampling_freq());
+		else
+			spec.set_source([this, &ch](size_t first, size_t n, double *out) { store.scan(ch.weights, first, n, out); },
+							frames, sampling_freq());
+		spec_shown = shown;
+	}
+	spec.step(4.0);
+	spec.draw();
+}
+
+void audio::draw_channel_select()
+{
+	for (uint c = 0; c < channels.size(); c++) {
+		if (c > 0)
+			ImGui::SameLine();
+		ImGui::RadioButton(channels[c].name.c_str(), &shown, c);
+	}
 }
 
 void audio::draw_full(sig_window &win) {
 	if(!ImPlot::BeginPlot("Full signal in time"))
 		return;
 	
+	channel &ch = channels[shown];
+	if (!ch.samples)
+		ImPlot::SetupAxisLimits(ImAxis_X1, 0.0, time_length(), ImPlotCond_Once);
 	win.draw();
-	ImPlot::PlotLine("Signal", af.samples[0].data(), num_samples(),
-					 time_length() / static_cast<double>(num_samples()), 0.0);
+	if (ch.samples)
+		ImPlot::PlotLine("Signal", ch.samples->data(), num_samples(),
+						 time_length() / static_cast<double>(num_samples()), 0.0);
+	else
+		plot_envelope(ch);
 	ImPlot::EndPlot();
 
 }
 
+// Bounded mode: the visible samples when few enough to draw, otherwise the
+// min/max envelope, so panning and zooming only read what is on screen.
+void audio::plot_envelope(channel &ch)
+{
+	static constexpr size_t max_points = 1 << 16;
+	ImPlotRect view = ImPlot::GetPlotLimits();
+	size_t first = std::min<double>(frames, std::max(0.0, view.X.Min * rate));
+	size_t end = std::min<double>(frames, std::max(0.0, view.X.Max * rate + 1.0));
+	if (end > first && end - first <= max_points) {
+		std::vector<double> x = read_samples(ch, first, end);
+		ImPlot::PlotLine("Signal", x.data(), x.size(), 1.0 / rate, first / rate);
+		return;
+	}
+
+	size_t e0 = first / envelope_frames;
+	size_t e1 = std::min(ch.env_min.size(), (end + envelope_frames - 1) / envelope_frames);
+	size_t group = std::max<size_t>(1, (e1 - e0) / (max_points / 2));
+	std::vector<double> t, lo, hi;
+	for (size_t e = e0; e < e1; e += group) {
+		size_t ge = std::min(e1, e + group);
+		t.push_back(e * envelope_frames / rate);
+		lo.push_back(*std::min_element(ch.env_min.begin() + e, ch.env_min.begin() + ge));
+		hi.push_back(*std::max_element(ch.env_max.begin() + e, ch.env_max.begin() + ge));
+	}
+	ImPlot::PlotShaded("Signal", t.data(), lo.data(), hi.data(), t.size());
+}
+
 double audio::win_len_t() {
-	return (last_win_len < 0) ? af.getNumSamplesPerChannel() : last_win_len;
+	return (last_win_len < 0) ? frames : last_win_len;
 }
 
 double audio::win_start_t() {
@@ -115,8 +512,12 @@ void audio::draw_windowed() {
 	if(!ImPlot::BeginPlot("Windowed signal in time"))
 		return;
 
-	ImPlot::PlotLine("Signal", windowed.data(), windowed.size(),
-					 last_win_len / static_cast<double>(windowed.size()), last_win_start);
+	uint n;
+	const double *x = region(channels[shown], n);
+	double t0 = win_first / sampling_freq();
+	ImPlot::PlotLine("Signal", x, n, 1.0 / analysis_freq(), t0);
+	if (win_coeffs.size() == n)
+		ImPlot::PlotLine("Window", win_coeffs.data(), n, 1.0 / analysis_freq(), t0);
 	
 	ImPlot::EndPlot();
 }
@@ -125,27 +526,50 @@ void audio::draw_fft() {
 	if(!ImPlot::BeginPlot("Frequency"))
 		return;
 
-	double fs = sampling_freq();
+	double fs = analysis_freq();
+	channel &ch = channels[shown];
 
-	ImPlot::PlotLine("Widmo", freq_amp.data(), freq_amp.size(),
-					 fs / windowed.size(), 0);
+	ImPlot::PlotLine("Widmo", ch.freq_amp.data(), ch.freq_amp.size(),
+					 fs / fft_size, 0);
 	ImPlot::EndPlot();
 	show_win_params();
 }
 
 void audio::recalc_win_params()
 {
+	audio_utils::parallel_for(channels.size(), [this](uint c) { recalc_win_params(channels[c]); });
+}
+
+void audio::recalc_win_params(channel &ch)
+{
+	trace::scope t("params", ch.name);
 	for (uint i = 0; i < params.size(); i++)
-		param_values[i] = (*params[i])(freq_amp.begin(), freq_amp.end());
+		ch.param_values[i] = ch.silent ? NAN : (*params[i])(ch.freq_amp.begin(), ch.freq_amp.end());
 }
 
 void audio::show_win_params()
 {
-	for (uint i = 0; i < params.size(); i++) {
-		ImGui::Text("%s: %lf", params[i]->name().c_str(), param_values[i]);
-		params[i]->draw_controls();
+	if (ImGui::BeginTable("Parameters", channels.size() + 1, ImGuiTableFlags_Borders)) {
+		ImGui::TableSetupColumn("Parameter");
+		for (auto &ch : channels)
+			ImGui::TableSetupColumn(ch.name.c_str());
+		ImGui::TableHeadersRow();
+
+		for (uint i = 0; i < params.size(); i++) {
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(params[i]->name().c_str());
+			for (auto &ch : channels) {
+				ImGui::TableNextColumn();
+				ImGui::Text("%lf", ch.param_values[i]);
+			}
+		}
+		ImGui::EndTable();
 	}
 
+	for (auto &p : params)
+		p->draw_controls();
+
 	if (ImGui::Button("Recalc"))
 		recalc_win_params();
 }
@@ -153,7 +577,6 @@ void audio::show_win_params()
 audio::sig_window::sig_window(bool is_rect, double start_s, double end_s, double a0)
             : rect(is_rect), start_time(start_s), end_time(end_s), a0(a0)
 {
-	std::cout << "start: " << start_time << ", end: " << end_time << "\n";
 	update_fun();
 }
 
@@ -185,12 +608,17 @@ void audio::sig_window::draw_controls(audio &a) {
 
 void audio::sig_window::update_fun() {
 	uint N = 100;
-	std::cout << (rect ? "Setting all to 1" : "Calculating stuff") << "\n";
 	for (uint i = 0; i < N; i++)
 		win_fun[i] = rect ? 1.0 : (a0 - (1 - a0) *
 					 cos(2.0 * M_PI * static_cast<double>(i) / static_cast<double>(N)));
 }
 
+double audio::sig_window::coeff(uint i, uint N) const {
+	if (rect)
+		return 1.0;
+	return a0 - (1 - a0) * cos(2.0 * M_PI * static_cast<double>(i) / static_cast<double>(N));
+}
+
 void audio::sig_window::apply(std::vector<double> &values) {
 	if (rect)
 		return;
@@ -198,8 +626,7 @@ void audio::sig_window::apply(std::vector<double> &values) {
 	uint N = values.size();
 
 	for (uint i = 0; i < N; i++) {
-		values[i] = values[i] * (a0 - (1 - a0) *
-					cos(2.0 * M_PI * static_cast<double>(i) / static_cast<double>(N)));
+		values[i] = values[i] * coeff(i, N);
 	}
 }
 
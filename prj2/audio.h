@@ -1,11 +1,18 @@
 #include "AudioFile.h"
+#include "sample_store.h"
 #include <map>
 #include <memory>
 #include <complex>
 #include <valarray>
+#include "mel.h"
 typedef unsigned int uint;
+
+class spectrogram;
 typedef std::complex<double> dcomplex;
 
+// Windows quieter than this (RMS) count as silence.
+static constexpr double silence_volume = 0.02;
+
 class freq_param
 {
 public:
@@ -15,15 +22,29 @@ public:
     virtual void draw_controls() = 0;
 };
 
+// Extra analysed signals derived from the file channels and evaluation mode.
+struct analysis_options
+{
+    bool mid_side = false;
+    bool downmix = false;
+    bool gate_silence = true;
+    // Decoded samples kept in memory, in MB, for WAV files; 0 decodes the
+    // whole file up front.
+    uint memory_budget_mb = 0;
+};
+
 class audio
 {
 public:
     audio() {}
-    void init(std::string filename);
-    int num_samples() {return af.getNumSamplesPerChannel();}
+    void init(std::string filename, analysis_options opts = analysis_options());
+    int num_samples() { return frames; }
     ~audio();
     bool is_loaded();
-    double time_length() { return af.getLengthInSeconds(); }
+    double time_length() { return frames / rate; }
+    // Samples are read through the chunk cache rather than held in full.
+    bool is_bounded() { return store.is_open(); }
+    sample_store &get_store() { return store; }
     struct sig_window {
         bool rect = true;
         float start_time = 0.0;
@@ -32,6 +53,7 @@ public:
         double win_fun[100];
         double win_tv[100];
         void update_fun();
+        double coeff(uint i, uint N) const;
         void apply(std::vector<double> &values);
         sig_window(bool is_rect, double start_s, double end_s, double a0);
         sig_window(bool is_rect, double a0, audio &a) {
@@ -43,17 +65,72 @@ public:
         void draw_controls(audio& a);
     };
     void apply_window(sig_window &win);
-    void update_fft();
+    // With details off only the spectrum, parameters and window MFCCs are
+    // updated; cepstrum and STFT MFCCs wait for the next full update.
+    void update_fft(bool details = true);
+    // Re-applies the window and updates the spectrum while the window is being
+    // edited, then fills in the details once it has been still for a moment.
+    bool follow_window(sig_window &win);
+    double update_ms() { return last_update_ms; }
     void draw_full(sig_window &win);
     void draw_windowed();
     void draw_fft();
+    void draw_channel_select();
+    void draw_mfcc();
+    // Feeds the shown channel to spec, computes a slice of it and draws it.
+    void draw_spectrogram(spectrogram &spec);
     double sampling_freq();
+    // Rate the spectrum is computed at, after the optional decimation stage.
+    double analysis_freq();
+    void set_decimation(uint factor);
+    uint get_decimation() { return decimation; }
 private:
+    struct channel {
+        std::string name;
+        // Null when bounded; the channel is then the weights mix of the file
+        // channels in the store, with a min/max envelope for the overview.
+        const std::vector<double> *samples = nullptr;
+        std::vector<double> weights;
+        std::vector<double> env_min;
+        std::vector<double> env_max;
+        // The analysed window when decimating or bounded; otherwise the
+        // window is read in place.
+        std::vector<double> region_copy;
+        std::vector<double> freq_amp;
+        std::vector<double> param_values;
+        double cepstrum_freq = 0.0;
+        bool silent = false;
+        std::vector<double> mfcc;
+        // mfcc_coeffs rows of stft_frames values
+        std::vector<double> stft_mfcc;
+        uint stft_frames = 0;
+    };
+    static constexpr uint mfcc_bands = 26;
+    static constexpr uint mfcc_coeffs = 13;
+    static constexpr uint stft_size = 1024;
+    static constexpr uint stft_hop = 512;
+    // Frames per entry of the bounded-mode envelope.
+    static constexpr uint envelope_frames = 1024;
+    filterbank::scale mfcc_scale = filterbank::mel;
+    uint win_first = 0;
+    uint win_end = 0;
+    uint fft_size = 0;
+    // Window weights over the analysed region, empty for a rectangular window.
+    std::vector<double> win_coeffs;
+    sig_window applied;
+    double last_update_ms = 0.0;
+    double last_update_time = -1.0;
+    bool details_pending = false;
+    analysis_options opts;
     AudioFile<double> af;
-    std::vector<double> windowed;
-    std::vector<double> tv;
+    sample_store store;
+    size_t frames = 0;
+    double rate = 1.0;
+    std::vector<std::vector<double>> derived;
+    std::vector<channel> channels;
+    int shown = 0;
+    int spec_shown = -1;
     std::vector<double> win_tv;
-    std::vector<double> freq_amp;
     std::vector<double> freq_vec;
     bool loaded = false;
     double last_win_len = -1.0;
@@ -61,8 +138,21 @@ private:
     double win_start_t();
     double win_len_t();
     std::vector<std::unique_ptr<freq_param>> params;
-    std::vector<double> param_values;
+    uint decimation = 1;
+    void build_params();
+    void add_mixes(analysis_options opts);
+    void build_envelopes();
+    // Longest window analysed when bounded, so its copies stay in budget too.
+    size_t max_window_frames();
+    void read_channel(channel &ch, size_t first, size_t n, double *out);
+    std::vector<double> read_samples(channel &ch, size_t first, size_t end);
+    const double *raw_window(channel &ch, std::vector<double> &buf);
+    void plot_envelope(channel &ch);
+    const double *region(const channel &ch, uint &n) const;
+    void channel_fft(channel &ch, bool details);
+    void stft_mfcc(channel &ch);
     void recalc_win_params();
+    void recalc_win_params(channel &ch);
     void show_win_params();
 };
 
@@ -1,30 +1,163 @@
-#include <complex>
+#include "fft.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
 #include <valarray>
+#include <vector>
 
-typedef std::complex<double> dcomplex;
 namespace audio_utils
 {
 
-static void fft_in_place(std::valarray<dcomplex> &time_series)
+// Runs fn(0) .. fn(n - 1) on up to hardware_concurrency threads.
+static inline void parallel_for(uint n, const std::function<void(uint)> &fn)
+{
+    uint workers = std::min(n, std::max(1u, std::thread::hardware_concurrency()));
+    std::atomic<uint> next(0);
+    auto work = [&]() {
+        for (uint i = next++; i < n; i = next++)
+            fn(i);
+    };
+
+    std::vector<std::thread> pool;
+    for (uint w = 1; w < workers; w++)
+        pool.emplace_back(work);
+    work();
+    for (auto &t : pool)
+        t.join();
+}
+
+// Radix-2 FFTs of `count` frames of N (a power of two) values at once, in
+// split layout: value j of frame f at re[j * count + f] and im[j * count + f].
+// Every butterfly applies one twiddle to all frames, so the innermost loop is
+// contiguous and vectorizes across frames, which the short transforms of an
+// STFT (256-2048 values) do not within a frame. Each frame gets the same
+// arithmetic as fft_radix2. count must be a multiple of fft_batch_width; pad
+// with zero frames.
+static constexpr size_t fft_batch_width = 8;
+
+// One butterfly on fft_batch_width frames. A fixed trip count and halves
+// that are known not to overlap let the compiler use vector instructions
+// without a scalar tail or aliasing checks, even at -O2.
+static inline void fft_batch_butterfly(double *__restrict lo_re, double *__restrict lo_im,
+                                       double *__restrict hi_re, double *__restrict hi_im,
+                                       double wr, double wi)
+{
+    for (size_t f = 0; f < fft_batch_width; f++)
+    {
+        double t_re = wr * hi_re[f] - wi * hi_im[f];
+        double t_im = wr * hi_im[f] + wi * hi_re[f];
+        hi_re[f] = lo_re[f] - t_re;
+        hi_im[f] = lo_im[f] - t_im;
+        lo_re[f] += t_re;
+        lo_im[f] += t_im;
+    }
+}
+
+static inline void fft_batch(double *re, double *im, size_t N, size_t count)
 {
-    const size_t N = time_series.size();
     if (N <= 1) return;
 
-    std::valarray<dcomplex> even = time_series[std::slice(0, N/2, 2)];
-    std::valarray<dcomplex> odd = time_series[std::slice(1, N/2, 2)];
+    for (size_t i = 1, j = 0; i < N; i++)
+    {
+        size_t bit = N >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j)
+        {
+            std::swap_ranges(re + i * count, re + (i + 1) * count, re + j * count);
+            std::swap_ranges(im + i * count, im + (i + 1) * count, im + j * count);
+        }
+    }
 
-    fft_in_place(even);
-    fft_in_place(odd);
+    const std::vector<dcomplex> &twiddle = fft_twiddles(N);
 
-    for (uint i = 0; i < N/2; i++)
+    for (size_t len = 2; len <= N; len <<= 1)
     {
-        dcomplex t = std::polar(1.0, -2 * M_PI * i / N) * odd[i];
-        time_series[i] = even[i] + t;
-        time_series[i+N/2] = even[i] - t;
+        size_t half = len / 2, step = N / len;
+        for (size_t first = 0; first < N; first += len)
+        {
+            for (size_t i = 0; i < half; i++)
+            {
+                double wr = twiddle[i * step].real(), wi = twiddle[i * step].imag();
+                double *lo_re = re + (first + i) * count, *lo_im = im + (first + i) * count;
+                double *hi_re = lo_re + half * count, *hi_im = lo_im + half * count;
+                for (size_t f = 0; f < count; f += fft_batch_width)
+                    fft_batch_butterfly(lo_re + f, lo_im + f, hi_re + f, hi_im + f, wr, wi);
+            }
+        }
     }
 }
 
-static void fft_inverse(std::valarray<dcomplex> &freq_series)
+// Blocked out-of-place transpose of a rows x cols matrix, bands of rows in parallel.
+static inline void transpose(const dcomplex *in, dcomplex *out, size_t rows, size_t cols)
+{
+    const size_t block = 32;
+    parallel_for((rows + block - 1) / block, [&](uint band) {
+        size_t r_end = std::min(rows, (band + 1) * block);
+        for (size_t c0 = 0; c0 < cols; c0 += block)
+        {
+            size_t c_end = std::min(cols, c0 + block);
+            for (size_t r = band * block; r < r_end; r++)
+                for (size_t c = c0; c < c_end; c++)
+                    out[c * rows + r] = in[r * cols + c];
+        }
+    });
+}
+
+// Four-step FFT for N = n1 * n2: n2 transforms of length n1, a twiddle pass,
+// then n1 transforms of length n2. The transposes in between make every
+// sub-transform a contiguous row of about sqrt(N) values, small enough to stay
+// in L2, and the rows of each step run on all cores.
+static inline void fft_four_step(dcomplex *x, size_t N)
+{
+    size_t n1 = 1;
+    while (n1 * n1 < N)
+        n1 <<= 1;
+    size_t n2 = N / n1;
+    std::vector<dcomplex> t(N);
+
+    // x[a * n2 + b] viewed as n1 x n2, t as n2 x n1.
+    transpose(x, t.data(), n1, n2);
+    parallel_for(n2, [&](uint r) {
+        dcomplex *row = &t[r * n1];
+        fft_radix2(row, n1);
+        // row[k] *= exp(-2 pi i r k / N), re-anchored every 64 steps to limit drift.
+        dcomplex step = std::polar(1.0, -2 * M_PI * r / N), w;
+        for (size_t k = 0; k < n1; k++)
+        {
+            if (k % 64 == 0)
+                w = std::polar(1.0, -2 * M_PI * static_cast<double>((r * k) % N) / N);
+            row[k] = dcomplex(w.real() * row[k].real() - w.imag() * row[k].imag(),
+                              w.real() * row[k].imag() + w.imag() * row[k].real());
+            w = dcomplex(w.real() * step.real() - w.imag() * step.imag(),
+                         w.real() * step.imag() + w.imag() * step.real());
+        }
+    });
+
+    transpose(t.data(), x, n2, n1);
+    parallel_for(n1, [&](uint r) { fft_radix2(x + r * n2, n2); });
+
+    // X[k1 + n1 * k2] sits at x[k1 * n2 + k2].
+    transpose(x, t.data(), n1, n2);
+    std::copy(t.begin(), t.end(), x);
+}
+
+// Transforms at least this long take the parallel four-step path.
+static constexpr size_t fft_four_step_min = 1 << 18;
+
+// In-place FFT; the size must be a power of two (zero-pad with next_pow2).
+static inline void fft_in_place(std::valarray<dcomplex> &time_series)
+{
+    const size_t N = time_series.size();
+    if (N >= fft_four_step_min)
+        fft_four_step(&time_series[0], N);
+    else if (N > 1)
+        fft_radix2(&time_series[0], N);
+}
+
+static inline void fft_inverse(std::valarray<dcomplex> &freq_series)
 {
     const size_t N = freq_series.size();
     if (N <= 1) return;
@@ -37,10 +170,53 @@ static void fft_inverse(std::valarray<dcomplex> &freq_series)
     freq_series /= N;
 }
 
-static void cepstrum(std::valarray<dcomplex> &fft)
+// Anti-aliased decimation by an integer factor. The windowed-sinc low-pass is
+// split into `factor` polyphase components so only kept samples are computed.
+static inline std::vector<double> decimate(const std::vector<double> &in, uint factor, uint taps = 12)
+{
+    if (factor <= 1)
+        return in;
+
+    uint n = factor * taps;
+    double cutoff = 0.45 / factor;
+    std::vector<double> h(n);
+    double sum = 0.0;
+    for (uint i = 0; i < n; i++) {
+        double x = static_cast<double>(i) - (n - 1) / 2.0;
+        double sinc = x == 0.0 ? 2.0 * cutoff : sin(2.0 * M_PI * cutoff * x) / (M_PI * x);
+        h[i] = sinc * (0.42 - 0.5 * cos(2.0 * M_PI * i / (n - 1)) + 0.08 * cos(4.0 * M_PI * i / (n - 1)));
+        sum += h[i];
+    }
+
+    std::vector<std::vector<double>> phases(factor, std::vector<double>(taps));
+    for (uint i = 0; i < n; i++)
+        phases[i % factor][i / factor] = h[i] / sum;
+
+    std::vector<double> out((in.size() + factor - 1) / factor);
+    long delay = static_cast<long>(n - 1) / 2;
+    for (size_t k = 0; k < out.size(); k++) {
+        long base = static_cast<long>(k * factor) + delay;
+        double acc = 0.0;
+        for (uint p = 0; p < factor; p++) {
+            for (uint j = 0; j < taps; j++) {
+                long idx = base - static_cast<long>(j * factor + p);
+                if (idx >= 0 && idx < static_cast<long>(in.size()))
+                    acc += phases[p][j] * in[idx];
+            }
+        }
+        out[k] = acc;
+    }
+
+    return out;
+}
+
+static inline void cepstrum(std::valarray<dcomplex> &fft)
 {
-    for (auto& c : fft)
-        c = log(c);
+    const size_t block = 1 << 16;
+    parallel_for((fft.size() + block - 1) / block, [&](uint b) {
+        for (size_t i = b * block; i < std::min(fft.size(), (b + 1) * block); i++)
+            fft[i] = log(fft[i]);
+    });
     
     fft_inverse(fft);
 }
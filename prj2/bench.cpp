@@ -0,0 +1,410 @@
+// Micro-benchmarks for the spectral parameters and the FFT on deterministic
+// synthetic signals. Prints a table on stderr and writes JSON results, e.g.
+//   make bench                      (writes bench.json)
+//   ./sound_bench results.json
+// With --verify it instead checks the FFT and the centroid against direct
+// reference computations and exits non-zero when a tolerance is exceeded:
+//   make verify
+//   ./sound_bench --verify [--abs-tol A] [--rel-tol R] [--rate-tol F]
+#include "audio.h"
+#include "audio_utils.h"
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <stdio.h>
+
+typedef std::chrono::steady_clock bench_clock;
+
+static constexpr double bench_fs = 44100.0;
+
+struct bench_signal {
+	std::string name;
+	std::vector<double> samples;
+};
+
+struct bench_result {
+	std::string kind;
+	std::string name;
+	std::string signal;
+	uint size;
+	// Transform length after zero-padding to a power of two.
+	uint padded;
+	double ns_per_sample;
+	double gb_per_s;
+};
+
+// Log sine sweep, white noise and speech-like voiced bursts with pauses and
+// noise consonants, all from fixed seeds.
+static std::vector<bench_signal> make_signals(size_t n)
+{
+	std::vector<bench_signal> out(3);
+	out[0].name = "sweep";
+	out[1].name = "noise";
+	out[2].name = "speech";
+	for (auto &s : out)
+		s.samples.resize(n);
+
+	double f0 = 50.0, f1 = 8000.0, len = n / bench_fs;
+	double k = log(f1 / f0) / len;
+	for (size_t i = 0; i < n; i++) {
+		double t = i / bench_fs;
+		out[0].samples[i] = 0.5 * sin(2.0 * M_PI * f0 * (exp(k * t) - 1.0) / k);
+	}
+
+	std::mt19937 rng(12345);
+	for (size_t i = 0; i < n; i++)
+		out[1].samples[i] = 0.3 * (static_cast<double>(rng()) / rng.max() * 2.0 - 1.0);
+
+	// 250 ms syllables: 150 ms voiced with a gliding pitch, 30 ms consonant, pause.
+	double phase = 0.0;
+	for (size_t i = 0; i < n; i++) {
+		double t = i / bench_fs;
+		double in_syl = fmod(t, 0.25);
+		uint syl = static_cast<uint>(t / 0.25);
+		double v = 0.0;
+		if (in_syl < 0.15) {
+			double pitch = 120.0 + 40.0 * (syl % 3) + 60.0 * in_syl;
+			phase += 2.0 * M_PI * pitch / bench_fs;
+			double env = sin(M_PI * in_syl / 0.15);
+			v = env * (0.4 * sin(phase) + 0.2 * sin(2.0 * phase) + 0.1 * sin(3.0 * phase + 0.5));
+		} else if (in_syl < 0.18) {
+			v = 0.05 * (static_cast<double>(rng()) / rng.max() * 2.0 - 1.0);
+		}
+		out[2].samples[i] = v;
+	}
+	return out;
+}
+
+// Seconds per call of fn: the best of `reps` runs, each repeating fn for at
+// least min_s so short kernels are not lost in clock resolution.
+static double time_best(const std::function<void()> &fn, uint reps = 3, double min_s = 0.01)
+{
+	double best = 1e30;
+	for (uint r = 0; r < reps; r++) {
+		uint calls = 0;
+		auto start = bench_clock::now();
+		double elapsed;
+		do {
+			fn();
+			calls++;
+			elapsed = std::chrono::duration<double>(bench_clock::now() - start).count();
+		} while (elapsed < min_s);
+		best = std::min(best, elapsed / calls);
+	}
+	return best;
+}
+
+// Power spectrum of the first 2 * bins samples, Hann windowed, scaled as in update_fft.
+static std::vector<double> power_spectrum(const std::vector<double> &x, uint bins)
+{
+	uint n = std::min<size_t>(2 * bins, x.size());
+	std::valarray<dcomplex> fft(dcomplex(0.0), 2 * bins);
+	for (uint i = 0; i < n; i++)
+		fft[i] = x[i] * (0.5 - 0.5 * cos(2.0 * M_PI * i / n));
+	audio_utils::fft_in_place(fft);
+
+	std::vector<double> amp(bins);
+	for (uint i = 0; i < bins; i++)
+		amp[i] = 2 * std::norm(fft[i]) / static_cast<double>(n);
+	return amp;
+}
+
+static void bench_params(const bench_signal &sig, uint bins, std::vector<bench_result> &results)
+{
+	std::vector<double> amp = power_spectrum(sig.samples, bins);
+	double nyquist = bench_fs / 2.0;
+
+	std::vector<std::unique_ptr<freq_param>> params;
+	params.push_back(std::make_unique<volume_param>());
+	params.push_back(std::make_unique<centroid_param>(nyquist));
+	params.push_back(std::make_unique<effective_bw_param>(nyquist));
+	for (uint b = 0; b < 4; b++)
+		params.push_back(std::make_unique<ber_param>(b));
+	params.push_back(std::make_unique<flatness_param>(0.1, 0.9));
+	params.push_back(std::make_unique<crest_param>(0.1, 0.9));
+
+	volatile double sink = 0.0;
+	for (auto &p : params) {
+		double s = time_best([&]() { sink = sink + (*p)(amp.begin(), amp.end()); });
+		results.push_back({ "freq_param", p->name(), sig.name, bins, bins, 1e9 * s / bins,
+		                    bins * sizeof(double) / s * 1e-9 });
+	}
+}
+
+// fft_in_place needs a power of two, so other sizes are zero-padded first
+// the way update_fft does; the time covers padding and transform.
+static void bench_fft(const bench_signal &sig, uint n, std::vector<bench_result> &results)
+{
+	uint padded = next_pow2(n);
+	std::valarray<dcomplex> fft(padded);
+	double s = time_best([&]() {
+		fft = dcomplex(0.0);
+		for (uint i = 0; i < n; i++)
+			fft[i] = sig.samples[i % sig.samples.size()];
+		audio_utils::fft_in_place(fft);
+	});
+	results.push_back({ "fft_in_place", padded == n ? "power of two" : "zero-padded", sig.name, n, padded,
+	                    1e9 * s / n, padded * sizeof(dcomplex) / s * 1e-9 });
+}
+
+// STFT-style work: `frames` Hann-windowed frames of n samples hopping by n / 2,
+// transformed one at a time with fft_radix2 and fft_batch_width at a time
+// with fft_batch. The time covers windowing and the layout change, as in the
+// spectrogram.
+static void bench_fft_frames(const bench_signal &sig, uint n, std::vector<bench_result> &results)
+{
+	const uint frames = 64;
+	std::vector<double> hann(n);
+	for (uint j = 0; j < n; j++)
+		hann[j] = 0.5 - 0.5 * cos(2.0 * M_PI * j / n);
+	auto at = [&](uint f, uint j) { return sig.samples[(static_cast<size_t>(f) * n / 2 + j) % sig.samples.size()] * hann[j]; };
+
+	std::vector<dcomplex> buf(n);
+	double single = time_best([&]() {
+		for (uint f = 0; f < frames; f++) {
+			for (uint j = 0; j < n; j++)
+				buf[j] = at(f, j);
+			fft_radix2(buf.data(), n);
+		}
+	});
+	const uint width = audio_utils::fft_batch_width;
+	std::vector<double> re(static_cast<size_t>(n) * width), im(re.size());
+	double batch = time_best([&]() {
+		for (uint f0 = 0; f0 < frames; f0 += width) {
+			for (uint j = 0; j < n; j++)
+				for (uint f = 0; f < width; f++) {
+					re[j * width + f] = at(f0 + f, j);
+					im[j * width + f] = 0.0;
+				}
+			audio_utils::fft_batch(re.data(), im.data(), n, width);
+		}
+	});
+
+	size_t values = static_cast<size_t>(n) * frames;
+	results.push_back({ "fft_frames", "fft_radix2 per frame", sig.name, n, n, 1e9 * single / values,
+	                    values * sizeof(dcomplex) / single * 1e-9 });
+	results.push_back({ "fft_frames", "fft_batch", sig.name, n, n, 1e9 * batch / values,
+	                    values * sizeof(dcomplex) / batch * 1e-9 });
+}
+
+static void write_json(const char *path, const std::vector<bench_result> &results)
+{
+	FILE *f = fopen(path, "w");
+	if (!f) {
+		fprintf(stderr, "cannot write %s\n", path);
+		return;
+	}
+	fprintf(f, "{\n  \"project\": \"prj2\",\n  \"sampling_rate\": %.0f,\n  \"threads\": %u,\n  \"results\": [\n",
+	        bench_fs, std::thread::hardware_concurrency());
+	for (size_t i = 0; i < results.size(); i++) {
+		const bench_result &r = results[i];
+		fprintf(f, "    {\"kind\": \"%s\", \"name\": \"%s\", \"signal\": \"%s\", \"size\": %u, \"padded\": %u, "
+		           "\"ns_per_sample\": %.4g, \"gb_per_s\": %.4g}%s\n",
+		        r.kind.c_str(), r.name.c_str(), r.signal.c_str(), r.size, r.padded, r.ns_per_sample, r.gb_per_s,
+		        i + 1 < results.size() ? "," : "");
+	}
+	fprintf(f, "  ]\n}\n");
+	fclose(f);
+}
+
+// A value passes when its error is within abs or rel; a check passes when
+// at most `rate` of its values fail.
+struct check_tolerance {
+	double abs;
+	double rel;
+	double rate;
+};
+
+struct check_result {
+	std::string name;
+	std::string signal;
+	uint values;
+	double max_abs;
+	double max_rel;
+	double mismatch;
+	bool pass;
+};
+
+static check_result compare(const std::string &name, const std::string &signal, const std::vector<double> &ref,
+                            const std::vector<double> &test, const check_tolerance &tol)
+{
+	check_result r = { name, signal, static_cast<uint>(ref.size()), 0.0, 0.0, 0.0, true };
+	uint bad = 0;
+	for (size_t i = 0; i < ref.size(); i++) {
+		double a = ref[i], b = test[i];
+		if (std::isnan(a) || std::isnan(b)) {
+			bad += std::isnan(a) != std::isnan(b);
+			continue;
+		}
+		double abs_err = fabs(a - b);
+		double rel_err = abs_err == 0.0 ? 0.0 : abs_err / fabs(a);
+		r.max_abs = std::max(r.max_abs, abs_err);
+		r.max_rel = std::max(r.max_rel, rel_err);
+		bad += abs_err > tol.abs && rel_err > tol.rel;
+	}
+	r.mismatch = ref.empty() ? 0.0 : static_cast<double>(bad) / ref.size();
+	r.pass = r.mismatch <= tol.rate;
+	return r;
+}
+
+// Real and imaginary parts scaled by 1 / sqrt(N), so bins of any size are
+// comparable with one absolute tolerance.
+static std::vector<double> unitary(const std::valarray<dcomplex> &x)
+{
+	double scale = 1.0 / sqrt(static_cast<double>(x.size()));
+	std::vector<double> out(2 * x.size());
+	for (size_t i = 0; i < x.size(); i++) {
+		out[2 * i] = x[i].real() * scale;
+		out[2 * i + 1] = x[i].imag() * scale;
+	}
+	return out;
+}
+
+// fft_in_place against a direct DFT (with exact twiddles in long double) at
+// small sizes, and the four-step path against plain radix-2 at large ones.
+static void verify_fft(const bench_signal &sig, const check_tolerance &tol, std::vector<check_result> &out)
+{
+	for (uint n : { 16, 64, 256, 1024, 4096 }) {
+		std::valarray<dcomplex> x(n), ref(n);
+		std::vector<std::complex<long double>> w(n);
+		for (uint i = 0; i < n; i++) {
+			x[i] = sig.samples[i];
+			w[i] = std::polar(1.0L, -2.0L * static_cast<long double>(M_PI) * i / n);
+		}
+		for (uint k = 0; k < n; k++) {
+			std::complex<long double> sum = 0.0L;
+			for (uint i = 0; i < n; i++)
+				sum += static_cast<long double>(x[i].real()) * w[(static_cast<size_t>(i) * k) % n];
+			ref[k] = dcomplex(static_cast<double>(sum.real()), static_cast<double>(sum.imag()));
+		}
+		audio_utils::fft_in_place(x);
+		out.push_back(compare("fft_in_place vs DFT " + std::to_string(n), sig.name, unitary(ref), unitary(x), tol));
+	}
+
+	for (uint n : { 1 << 18, 1 << 19 }) {
+		std::valarray<dcomplex> x(n);
+		for (uint i = 0; i < n; i++)
+			x[i] = sig.samples[i % sig.samples.size()];
+		std::valarray<dcomplex> ref = x;
+		fft_radix2(&ref[0], n);
+		audio_utils::fft_in_place(x);
+		out.push_back(compare("four-step vs radix-2 " + std::to_string(n), sig.name, unitary(ref), unitary(x), tol));
+	}
+}
+
+// fft_batch against fft_radix2 on each of its frames, consecutive pieces of
+// the signal.
+static void verify_fft_batch(const bench_signal &sig, const check_tolerance &tol, std::vector<check_result> &out)
+{
+	const uint frames = 2 * audio_utils::fft_batch_width;
+	for (uint n : { 16, 256, 1024, 2048 }) {
+		std::valarray<dcomplex> ref(static_cast<size_t>(n) * frames), test(ref.size());
+		std::vector<double> re(ref.size()), im(ref.size(), 0.0);
+		for (uint f = 0; f < frames; f++)
+			for (uint j = 0; j < n; j++)
+				re[j * frames + f] = sig.samples[(static_cast<size_t>(f) * n + j) % sig.samples.size()];
+		for (uint f = 0; f < frames; f++) {
+			for (uint j = 0; j < n; j++)
+				ref[f * n + j] = re[j * frames + f];
+			fft_radix2(&ref[f * n], n);
+		}
+		audio_utils::fft_batch(re.data(), im.data(), n, frames);
+		for (uint f = 0; f < frames; f++)
+			for (uint k = 0; k < n; k++)
+				test[f * n + k] = dcomplex(re[k * frames + f], im[k * frames + f]);
+		out.push_back(compare("fft_batch vs radix-2 " + std::to_string(n), sig.name, unitary(ref), unitary(test), tol));
+	}
+}
+
+// centroid_param against the textbook formula in long double, one value per
+// windowed spectrum along the signal.
+static void verify_centroid(const bench_signal &sig, uint bins, const check_tolerance &tol,
+                            std::vector<check_result> &out)
+{
+	double nyquist = bench_fs / 2.0;
+	centroid_param cp(nyquist);
+	std::vector<double> ref, test;
+	for (size_t off = 0; off + 2 * bins <= sig.samples.size(); off += 2 * bins) {
+		std::vector<double> frame(sig.samples.begin() + off, sig.samples.begin() + off + 2 * bins);
+		std::vector<double> amp = power_spectrum(frame, bins);
+		long double num = 0.0L, den = 0.0L;
+		for (uint k = 0; k < bins; k++) {
+			long double a = sqrtl(amp[k]);
+			num += a * k * nyquist / bins;
+			den += a;
+		}
+		ref.push_back(den > 0.0L ? static_cast<double>(num / den) : NAN);
+		test.push_back(cp(amp.begin(), amp.end()));
+	}
+	out.push_back(compare(cp.name() + " " + std::to_string(bins), sig.name, ref, test, tol));
+}
+
+static int verify(int argc, char **argv)
+{
+	// Defaults: the FFT is held to an absolute error on the unit-scaled
+	// spectrum (bins near zero make relative errors meaningless); the
+	// centroid only sums in another order than the reference.
+	check_tolerance fft_tol = { 1e-12, 0.0, 0.0 };
+	check_tolerance centroid_tol = { 1e-9, 1e-12, 0.0 };
+	for (int i = 2; i + 1 < argc; i += 2) {
+		double v = atof(argv[i + 1]);
+		for (check_tolerance *t : { &fft_tol, &centroid_tol }) {
+			if (!strcmp(argv[i], "--abs-tol"))
+				t->abs = v;
+			else if (!strcmp(argv[i], "--rel-tol"))
+				t->rel = v;
+			else if (!strcmp(argv[i], "--rate-tol"))
+				t->rate = v;
+		}
+	}
+
+	std::vector<bench_signal> signals = make_signals(static_cast<size_t>(bench_fs));
+	std::vector<check_result> results;
+	for (auto &sig : signals) {
+		verify_fft(sig, fft_tol, results);
+		verify_fft_batch(sig, fft_tol, results);
+		for (uint bins : { 256, 1024, 4096 })
+			verify_centroid(sig, bins, centroid_tol, results);
+	}
+
+	uint failed = 0;
+	printf("%-4s %-32s %-7s %7s %11s %11s %9s\n", "", "check", "signal", "values", "max abs", "max rel", "mismatch");
+	for (auto &r : results) {
+		failed += !r.pass;
+		printf("%-4s %-32s %-7s %7u %11.3g %11.3g %8.2f%%\n", r.pass ? "ok" : "FAIL", r.name.c_str(),
+		       r.signal.c_str(), r.values, r.max_abs, r.max_rel, 100.0 * r.mismatch);
+	}
+	printf("%zu checks, %u failed\n", results.size(), failed);
+	return failed ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 1 && !strcmp(argv[1], "--verify"))
+		return verify(argc, argv);
+
+	const char *out = argc > 1 ? argv[1] : "bench.json";
+	std::vector<bench_signal> signals = make_signals(static_cast<size_t>(bench_fs));
+	std::vector<bench_result> results;
+
+	const uint spectrum_sizes[] = { 256, 1024, 4096, 16384, 65536 };
+	const uint fft_sizes[] = { 256, 1024, 4096, 16384, 65536, 1 << 18, 1 << 20,
+	                           1000, 1200, 44100, 48000, 300000 };
+	for (auto &sig : signals)
+		for (uint bins : spectrum_sizes)
+			bench_params(sig, bins, results);
+	// The transform does not depend on the content.
+	for (uint n : fft_sizes)
+		bench_fft(signals[1], n, results);
+	for (uint n : { 256, 512, 1024, 2048 })
+		bench_fft_frames(signals[1], n, results);
+
+	fprintf(stderr, "%-12s %-28s %-7s %8s %8s %12s %8s\n", "kind", "name", "signal", "size", "padded",
+	        "ns/sample", "GB/s");
+	for (auto &r : results)
+		fprintf(stderr, "%-12s %-28s %-7s %8u %8u %12.3f %8.3f\n", r.kind.c_str(), r.name.c_str(),
+		        r.signal.c_str(), r.size, r.padded, r.ns_per_sample, r.gb_per_s);
+	write_json(out, results);
+	fprintf(stderr, "wrote %zu results to %s\n", results.size(), out);
+	return 0;
+}
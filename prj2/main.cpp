@@ -7,11 +7,47 @@
 #include <SDL_image.h>
 #include <imfilebrowser.h>
 #include "audio.h"
+#include "spectrogram.h"
+#include "trace.h"
 
 #if !SDL_VERSION_ATLEAST(2,0,17)
 #error This backend requires SDL 2.0.17+ because of SDL_RenderGeometry() function
 #endif
 
+// Per-stage timings and counters recorded since the last load.
+static void draw_trace()
+{
+	static std::string status;
+	ImGui::Begin("Trace");
+	bool on = trace::on();
+	if (ImGui::Checkbox("Record", &on))
+		trace::enabled = on;
+	ImGui::SameLine();
+	if (ImGui::Button("Export Chrome trace"))
+		status = trace::write_chrome("trace.json") ? "wrote trace.json" : "cannot write trace.json";
+	ImGui::SameLine();
+	ImGui::TextUnformatted(status.c_str());
+
+	if (ImGui::BeginTable("Stages", 4, ImGuiTableFlags_Borders)) {
+		ImGui::TableSetupColumn("Stage");
+		ImGui::TableSetupColumn("Calls");
+		ImGui::TableSetupColumn("Total ms");
+		ImGui::TableSetupColumn("Max ms");
+		ImGui::TableHeadersRow();
+		for (auto &s : trace::stages()) {
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn(); ImGui::TextUnformatted(s.name.c_str());
+			ImGui::TableNextColumn(); ImGui::Text("%u", s.calls);
+			ImGui::TableNextColumn(); ImGui::Text("%.2f", s.total_ms);
+			ImGui::TableNextColumn(); ImGui::Text("%.2f", s.max_ms);
+		}
+		ImGui::EndTable();
+	}
+	for (auto &c : trace::counters())
+		ImGui::Text("%s: %lld", c.name.c_str(), static_cast<long long>(c.value));
+	ImGui::End();
+}
+
 // Main code
 int main(int, char**)
 {
@@ -55,6 +91,10 @@ int main(int, char**)
 	fileDialog.SetTypeFilters({ ".wav" });
 	audio a;
 	audio::sig_window win;
+	spectrogram spec(renderer);
+	analysis_options opts;
+	int budget_mb = 0;
+	bool live = true;
 
 	// Our state
 	ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
@@ -88,16 +128,40 @@ int main(int, char**)
 		ImGui::Begin("Audio");
 
 		if (a.is_loaded()) {
+			trace::scope plot("plot");
 			ImGui::Text("Loaded");
-			
+			if (a.is_bounded()) {
+				sample_store &store = a.get_store();
+				ImGui::SameLine();
+				ImGui::Text("(chunk cache %.1f of %.1f MB, %zu hits, %zu misses)", store.resident_bytes() / 1048576.0,
+							store.budget() / 1048576.0, store.hits(), store.misses());
+			}
+			a.draw_channel_select();
+
 			a.draw_full(win);
-			if (ImGui::Button("Apply window"))
+			ImGui::Checkbox("Live update", &live);
+			if (!live) {
+				ImGui::SameLine();
+				if (ImGui::Button("Apply window"))
+					a.apply_window(win);
+			}
+			ImGui::SameLine();
+			ImGui::Text("Last update: %.1f ms", a.update_ms());
+
+			static const char *factors[] = { "1", "2", "4", "8" };
+			int dec = static_cast<int>(log2(a.get_decimation()));
+			if (ImGui::Combo("Decimation", &dec, factors, IM_ARRAYSIZE(factors))) {
+				a.set_decimation(1u << dec);
 				a.apply_window(win);
+				if (live)
+					a.update_fft();
+			}
 
 			a.draw_windowed();
-			if (ImGui::Button("Do FFT"))
+			if (!live && ImGui::Button("Do FFT"))
 				a.update_fft();
 			a.draw_fft();
+			a.draw_mfcc();
 		}
 		ImGui::End();
 
@@ -110,9 +174,24 @@ int main(int, char**)
 		win.draw_controls(a);
 		ImGui::End();
 
+		if (live && a.is_loaded())
+			a.follow_window(win);
+		draw_trace();
+
+		ImGui::Begin("Spectrogram");
+		if (a.is_loaded())
+			a.draw_spectrogram(spec);
+		ImGui::End();
+
 
 		ImGui::Begin("File");
 
+		ImGui::Checkbox("Mid/side", &opts.mid_side); ImGui::SameLine();
+		ImGui::Checkbox("Downmix", &opts.downmix); ImGui::SameLine();
+		ImGui::Checkbox("Skip silent windows", &opts.gate_silence);
+		if (ImGui::InputInt("Memory budget (MB, 0 = whole file)", &budget_mb))
+			budget_mb = std::max(0, budget_mb);
+		opts.memory_budget_mb = budget_mb;
 		if (ImGui::Button("Open file"))
 			fileDialog.Open();
 
@@ -120,9 +199,11 @@ int main(int, char**)
 		if (fileDialog.HasSelected())
 		{
 			std::cout << "Loading " << fileDialog.GetSelected().string() << "\n";
-			a.init(fileDialog.GetSelected().string());
+			a.init(fileDialog.GetSelected().string(), opts);
 			win = audio::sig_window(a);
 			a.apply_window(win);
+			if (live)
+				a.update_fft();
 			fileDialog.ClearSelected();
 		}
 		ImGui::End();
@@ -140,6 +221,7 @@ int main(int, char**)
 	}
 
 	// Cleanup
+	spec.release();
 	ImGui_ImplSDLRenderer_Shutdown();
 	ImGui_ImplSDL2_Shutdown();
 	ImPlot::CreateContext();
@@ -0,0 +1,110 @@
+#include "mel.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+static double to_scale(double f, filterbank::scale s)
+{
+	if (s == filterbank::bark)
+		return 26.81 * f / (1960.0 + f) - 0.53;
+	return 2595.0 * log10(1.0 + f / 700.0);
+}
+
+static double from_scale(double z, filterbank::scale s)
+{
+	if (s == filterbank::bark)
+		return 1960.0 * (z + 0.53) / (26.28 - z);
+	return 700.0 * (pow(10.0, z / 2595.0) - 1.0);
+}
+
+filterbank::filterbank(uint num_bins, double rate, uint num_bands, scale s) : bins(num_bins)
+{
+	double bin_hz = rate / 2.0 / num_bins;
+	double low = to_scale(0.0, s);
+	double high = to_scale(rate / 2.0, s);
+
+	std::vector<double> edges(num_bands + 2);
+	for (uint i = 0; i < edges.size(); i++)
+		edges[i] = from_scale(low + (high - low) * i / (num_bands + 1), s) / bin_hz;
+
+	bands.resize(num_bands);
+	for (uint b = 0; b < num_bands; b++) {
+		double left = edges[b], centre = edges[b + 1], right = edges[b + 2];
+		uint first = static_cast<uint>(ceil(left));
+		uint last = std::min(static_cast<uint>(floor(right)), num_bins - 1);
+
+		band &bd = bands[b];
+		bd.first = first;
+		for (uint k = first; k <= last && k < num_bins; k++) {
+			double w = k < centre ? (k - left) / (centre - left) : (right - k) / (right - centre);
+			bd.weights.push_back(std::max(0.0, w));
+		}
+
+		// Low bands can be narrower than a bin; fall back to the nearest one.
+		if (bd.weights.empty()) {
+			bd.first = std::min(static_cast<uint>(round(centre)), num_bins - 1);
+			bd.weights.push_back(1.0);
+		}
+	}
+}
+
+void filterbank::apply(const double *power, double *band_energy) const
+{
+	for (uint b = 0; b < bands.size(); b++) {
+		const band &bd = bands[b];
+		const double *p = power + bd.first;
+		double sum = 0.0;
+		for (uint i = 0; i < bd.weights.size(); i++)
+			sum += bd.weights[i] * p[i];
+		band_energy[b] = sum;
+	}
+}
+
+const filterbank &filterbank::get(uint num_bins, double rate, uint num_bands, scale s)
+{
+	static std::mutex mtx;
+	static std::map<std::tuple<uint, double, uint, scale>, std::unique_ptr<filterbank>> cache;
+
+	std::lock_guard<std::mutex> lock(mtx);
+	auto &fb = cache[std::make_tuple(num_bins, rate, num_bands, s)];
+	if (!fb)
+		fb = std::make_unique<filterbank>(num_bins, rate, num_bands, s);
+	return *fb;
+}
+
+// DCT-II basis for (num_bands, num_coeffs), built on first request.
+static const std::vector<double> &dct_matrix(uint num_bands, uint num_coeffs)
+{
+	static std::mutex mtx;
+	static std::map<std::pair<uint, uint>, std::vector<double>> cache;
+
+	std::lock_guard<std::mutex> lock(mtx);
+	std::vector<double> &m = cache[std::make_pair(num_bands, num_coeffs)];
+	if (m.empty()) {
+		m.resize(num_bands * num_coeffs);
+		for (uint k = 0; k < num_coeffs; k++)
+			for (uint b = 0; b < num_bands; b++)
+				m[k * num_bands + b] = cos(M_PI * k * (b + 0.5) / num_bands);
+	}
+	return m;
+}
+
+void mfcc(const filterbank &fb, const double *power, uint num_coeffs, double *out)
+{
+	uint nb = fb.size();
+	std::vector<double> energy(nb);
+	fb.apply(power, energy.data());
+	for (auto &e : energy)
+		e = log(std::max(e, 1e-12));
+
+	const std::vector<double> &dct = dct_matrix(nb, num_coeffs);
+	for (uint k = 0; k < num_coeffs; k++) {
+		double sum = 0.0;
+		for (uint b = 0; b < nb; b++)
+			sum += dct[k * nb + b] * energy[b];
+		out[k] = sum;
+	}
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <vector>
+typedef unsigned int uint;
+
+// Triangular perceptual filterbank over a one-sided power spectrum of
+// num_bins bins covering [0, rate / 2). Each band keeps only its non-zero
+// weights, so applying it costs one multiply-add per weight.
+class filterbank
+{
+public:
+    enum scale { mel, bark };
+
+    filterbank(uint num_bins, double rate, uint num_bands, scale s);
+    void apply(const double *power, double *band_energy) const;
+    uint size() const { return bands.size(); }
+    uint num_bins() const { return bins; }
+
+    // Shared filterbank for the given layout, built on first request.
+    static const filterbank &get(uint num_bins, double rate, uint num_bands, scale s);
+
+private:
+    struct band {
+        uint first;
+        std::vector<double> weights;
+    };
+    uint bins;
+    std::vector<band> bands;
+};
+
+// Log band energies followed by a DCT-II, keeping the first num_coeffs terms.
+void mfcc(const filterbank &fb, const double *power, uint num_coeffs, double *out);
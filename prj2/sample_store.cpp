@@ -0,0 +1,116 @@
+#include "sample_store.h"
+#include "trace.h"
+#include <algorithm>
+
+bool sample_store::open(const std::string &path, size_t budget_bytes)
+{
+	close();
+	limit = budget_bytes;
+	// Chunks are read wherever the view goes, not front to back.
+	return wav.open(path, wav_file::access_random);
+}
+
+void sample_store::close()
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	order.clear();
+	chunks.clear();
+	resident = 0;
+	num_hits = 0;
+	num_misses = 0;
+	wav.close();
+}
+
+std::shared_ptr<const std::vector<double>> sample_store::fetch(uint c, size_t index)
+{
+	chunk_key key(c, index);
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		auto it = chunks.find(key);
+		if (it != chunks.end()) {
+			order.splice(order.begin(), order, it->second.pos);
+			num_hits++;
+			return it->second.samples;
+		}
+	}
+
+	size_t first = index * chunk_frames;
+	auto samples = std::make_shared<std::vector<double>>(std::min(chunk_frames, num_frames() - first));
+	wav.read(c, first, samples->size(), samples->data());
+	trace::count("chunks decoded", 1);
+	trace::count("bytes decoded", samples->size() * sizeof(double));
+
+	std::lock_guard<std::mutex> lock(mtx);
+	num_misses++;
+	// Another thread may have decoded the same chunk meanwhile.
+	auto it = chunks.find(key);
+	if (it != chunks.end()) {
+		order.splice(order.begin(), order, it->second.pos);
+		return it->second.samples;
+	}
+	order.push_front(key);
+	chunks[key] = { samples, order.begin() };
+	resident += samples->size() * sizeof(double);
+
+	// Readers keep their own reference, so dropping a chunk here is safe.
+	while (resident > limit && order.size() > 1) {
+		auto last = chunks.find(order.back());
+		resident -= last->second.samples->size() * sizeof(double);
+		chunks.erase(last);
+		order.pop_back();
+	}
+	return samples;
+}
+
+void sample_store::read(const std::vector<double> &weights, size_t first, size_t n, double *out)
+{
+	std::fill(out, out + n, 0.0);
+	size_t end = std::min(first + n, num_frames());
+	for (uint c = 0; c < weights.size() && c < num_channels(); c++) {
+		if (weights[c] == 0.0)
+			continue;
+		for (size_t pos = first; pos < end;) {
+			size_t index = pos / chunk_frames;
+			size_t offset = pos - index * chunk_frames;
+			std::shared_ptr<const std::vector<double>> chunk = fetch(c, index);
+			size_t count = std::min(end - pos, chunk->size() - offset);
+			const double *x = chunk->data() + offset;
+			double *y = out + (pos - first);
+			for (size_t i = 0; i < count; i++)
+				y[i] += weights[c] * x[i];
+			pos += count;
+		}
+	}
+}
+
+void sample_store::scan(const std::vector<double> &weights, size_t first, size_t n, double *out) const
+{
+	std::fill(out, out + n, 0.0);
+	size_t count = first < num_frames() ? std::min(n, num_frames() - first) : 0;
+	std::vector<double> x(count);
+	for (uint c = 0; c < weights.size() && c < num_channels(); c++) {
+		if (weights[c] == 0.0)
+			continue;
+		wav.read(c, first, count, x.data());
+		for (size_t i = 0; i < count; i++)
+			out[i] += weights[c] * x[i];
+	}
+}
+
+size_t sample_store::resident_bytes()
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	return resident;
+}
+
+size_t sample_store::hits()
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	return num_hits;
+}
+
+size_t sample_store::misses()
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	return num_misses;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "wav_file.h"
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Decoded samples of a WAV file for random access within a memory budget.
+// Each channel is cut into chunks of chunk_frames; chunks are decoded from
+// the mapped file when first read and the least recently used ones are
+// dropped once more than the budget is resident. Safe to read from several
+// threads; decoding runs outside the lock.
+class sample_store
+{
+public:
+    static constexpr size_t chunk_frames = 1 << 16;
+
+    bool open(const std::string &path, size_t budget_bytes);
+    void close();
+    bool is_open() const { return wav.is_open(); }
+    const std::string &error() const { return wav.error(); }
+
+    uint num_channels() const { return wav.num_channels(); }
+    size_t num_frames() const { return wav.num_frames(); }
+    double sampling_rate() const { return wav.sample_rate(); }
+    size_t budget() const { return limit; }
+
+    // out[i] = sum of weights[c] * channel c at first + i, for i < n; frames
+    // past the end read as 0.
+    void read(const std::vector<double> &weights, size_t first, size_t n, double *out);
+    // The same straight from the file, without touching the cache, for one
+    // pass over the whole recording.
+    void scan(const std::vector<double> &weights, size_t first, size_t n, double *out) const;
+
+    size_t resident_bytes();
+    size_t hits();
+    size_t misses();
+
+private:
+    typedef std::pair<uint, size_t> chunk_key;
+    struct entry {
+        std::shared_ptr<const std::vector<double>> samples;
+        std::list<chunk_key>::iterator pos;
+    };
+
+    wav_file wav;
+    size_t limit = 0;
+    std::mutex mtx;
+    // Most recently used first.
+    std::list<chunk_key> order;
+    std::map<chunk_key, entry> chunks;
+    size_t resident = 0;
+    size_t num_hits = 0;
+    size_t num_misses = 0;
+
+    std::shared_ptr<const std::vector<double>> fetch(uint c, size_t index);
+};
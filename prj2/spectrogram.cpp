@@ -0,0 +1,196 @@
+#include "spectrogram.h"
+#include "audio_utils.h"
+#include "imgui.h"
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+void spectrogram::release()
+{
+	if (texture)
+		SDL_DestroyTexture(texture);
+	texture = nullptr;
+	tex_level = -1;
+}
+
+// Colour for every stored level under the current dB range and colormap, ARGB8888.
+void spectrogram::build_lut()
+{
+	static const float heat_points[][3] = {
+		{ 0.f, 0.f, 0.f }, { 0.f, 0.f, 0.6f }, { 0.8f, 0.f, 0.3f }, { 1.f, 0.6f, 0.f }, { 1.f, 1.f, 0.9f }
+	};
+	const uint num_points = sizeof(heat_points) / sizeof(heat_points[0]);
+
+	for (uint i = 0; i < 256; i++) {
+		float db = store_min_db + (store_max_db - store_min_db) * i / 255.f;
+		float t = std::max(0.f, std::min(1.f, (db - min_db) / std::max(max_db - min_db, 1e-3f)));
+		float rgb[3] = { t, t, t };
+		if (cmap == heat) {
+			float pos = t * (num_points - 1);
+			uint p = std::min(static_cast<uint>(pos), num_points - 2);
+			float f = pos - p;
+			for (uint k = 0; k < 3; k++)
+				rgb[k] = heat_points[p][k] + (heat_points[p + 1][k] - heat_points[p][k]) * f;
+		}
+		lut[i] = 0xff000000u | static_cast<uint32_t>(rgb[0] * 255.f) << 16 |
+			static_cast<uint32_t>(rgb[1] * 255.f) << 8 | static_cast<uint32_t>(rgb[2] * 255.f);
+	}
+}
+
+void spectrogram::set_source(reader read, size_t num_samples, double rate)
+{
+	this->read = read;
+	this->num_samples = read ? num_samples : 0;
+	this->rate = rate;
+	total_columns = (this->num_samples + hop - 1) / hop;
+	levels.assign(1, std::vector<uint8_t>());
+	levels[0].reserve(static_cast<size_t>(total_columns) * bins);
+
+	hann.resize(fft_size);
+	for (uint i = 0; i < fft_size; i++)
+		hann[i] = 0.5 - 0.5 * cos(2.0 * M_PI * i / fft_size);
+
+	view_start = 0.f;
+	view_end = this->num_samples / rate;
+	tex_level = -1;
+}
+
+// Level-0 columns [first, first + count) in parallel, then the mip levels above them.
+void spectrogram::compute(uint first, uint count)
+{
+	std::vector<uint8_t> &base = levels[0];
+	base.resize(static_cast<size_t>(first + count) * bins);
+	// Squared amplitude relative to a full-scale sine: (2 |X| / sum(window))^2, sum(window) = N / 2.
+	const double norm = 16.0 / (static_cast<double>(fft_size) * fft_size);
+	const double scale = 255.0 / (store_max_db - store_min_db);
+	trace::count("spectrogram columns", count);
+
+	// One read covers every column of the batch.
+	std::vector<double> x(static_cast<size_t>(count - 1) * hop + fft_size);
+	read(static_cast<size_t>(first) * hop, x.size(), x.data());
+
+	// Columns go through the FFT fft_batch_width at a time, in the split layout
+	// fft_batch wants; the last group is padded with silent columns.
+	const uint width = audio_utils::fft_batch_width;
+	audio_utils::parallel_for((count + width - 1) / width, [&](uint g) {
+		uint c0 = g * width, n = std::min(width, count - c0);
+		std::vector<double> re(fft_size * width, 0.0), im(fft_size * width, 0.0);
+		for (uint i = 0; i < n; i++)
+			for (uint j = 0; j < fft_size; j++)
+				re[j * width + i] = x[(c0 + i) * hop + j] * hann[j];
+		audio_utils::fft_batch(re.data(), im.data(), fft_size, width);
+
+		for (uint i = 0; i < n; i++) {
+			double db[bins];
+			for (uint k = 0; k < bins; k++)
+				db[k] = (re[k * width + i] * re[k * width + i] + im[k * width + i] * im[k * width + i]) * norm + 1e-30;
+			for (uint k = 0; k < bins; k++)
+				db[k] = 10.0 * log10(db[k]);
+			uint8_t *out = &base[(first + c0 + i) * static_cast<size_t>(bins)];
+			for (uint k = 0; k < bins; k++)
+				out[k] = static_cast<uint8_t>(std::max(0.0, std::min(255.0, (db[k] - store_min_db) * scale)));
+		}
+	});
+
+	// An odd column left at the end of a finished level is kept on its own.
+	bool complete = columns(0) == total_columns;
+	for (uint l = 1; columns(l - 1) > 1; l++) {
+		if (levels.size() <= l)
+			levels.emplace_back();
+		uint have = columns(l);
+		uint want = complete ? (columns(l - 1) + 1) / 2 : columns(l - 1) / 2;
+		const std::vector<uint8_t> &below = levels[l - 1];
+		std::vector<uint8_t> &level = levels[l];
+		level.resize(static_cast<size_t>(want) * bins);
+		for (uint c = have; c < want; c++) {
+			const uint8_t *a = &below[2 * c * static_cast<size_t>(bins)];
+			const uint8_t *b = 2 * c + 1 < columns(l - 1) ? a + bins : a;
+			for (uint k = 0; k < bins; k++)
+				level[c * static_cast<size_t>(bins) + k] = std::max(a[k], b[k]);
+		}
+	}
+}
+
+void spectrogram::step(double budget_ms)
+{
+	if (!read || columns(0) >= total_columns)
+		return;
+
+	trace::scope t("spectrogram");
+	auto start = std::chrono::steady_clock::now();
+	uint batch = 16 * std::max(1u, std::thread::hardware_concurrency());
+	while (columns(0) < total_columns) {
+		compute(columns(0), std::min(batch, total_columns - columns(0)));
+		if (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() > budget_ms)
+			break;
+	}
+}
+
+// Points the texture at the mip level and columns the view needs. A new
+// target is uploaded whole; after that only newly computed columns are sent.
+void spectrogram::upload(uint end)
+{
+	uint c0 = std::min(static_cast<uint>(view_start * rate / hop), end - 1);
+	uint c1 = std::max(c0 + 1, std::min(end, static_cast<uint>(ceil(view_end * rate / hop))));
+	int level = 0;
+	while (((c1 - c0 + (1u << level) - 1) >> level) > tex_width)
+		level++;
+	level = std::min(level, static_cast<int>(levels.size()) - 1);
+
+	uint first = c0 >> level;
+	tex_span = std::min(1.f, static_cast<float>((c1 - c0 + (1u << level) - 1) >> level) / tex_width);
+	uint from = tex_filled;
+	uint to = std::min(columns(level), first + tex_width);
+	if (level != tex_level || first != tex_first) {
+		tex_level = level;
+		tex_first = first;
+		from = first;
+		to = first + tex_width;
+	}
+	if (from >= to)
+		return;
+
+	uint n = to - from;
+	uint avail = columns(level);
+	const std::vector<uint8_t> &src = levels[level];
+	std::vector<uint32_t> pixels(static_cast<size_t>(n) * bins);
+	for (uint x = 0; x < n; x++) {
+		uint c = from + x;
+		for (uint k = 0; k < bins; k++)
+			pixels[(bins - 1 - k) * n + x] = c < avail ? lut[src[c * static_cast<size_t>(bins) + k]] : lut[0];
+	}
+
+	SDL_Rect rect { static_cast<int>(from - tex_first), 0, static_cast<int>(n), static_cast<int>(bins) };
+	SDL_UpdateTexture(texture, &rect, pixels.data(), n * sizeof(uint32_t));
+	tex_filled = std::min(avail, first + tex_width);
+}
+
+void spectrogram::draw()
+{
+	if (!read || total_columns == 0)
+		return;
+	if (!texture)
+		texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+									tex_width, bins);
+	if (!texture)
+		return;
+
+	bool recolor = ImGui::DragFloatRange2("Colour range (dB)", &min_db, &max_db, 0.5f, store_min_db, store_max_db);
+	recolor |= ImGui::RadioButton("heat", &cmap, heat);
+	ImGui::SameLine();
+	recolor |= ImGui::RadioButton("gray", &cmap, gray);
+	if (recolor) {
+		build_lut();
+		tex_level = -1;
+	}
+
+	float length = num_samples / rate;
+	ImGui::DragFloatRange2("View (s)", &view_start, &view_end, 0.01f, 0.f, length);
+	upload(total_columns);
+
+	ImGui::Text("%u / %u columns, level %d", columns(0), total_columns, tex_level);
+	ImGui::Image(static_cast<ImTextureID>(texture), ImVec2(ImGui::GetContentRegionAvail().x, 256.f),
+				 ImVec2(0.f, 0.f), ImVec2(tex_span, 1.f));
+}
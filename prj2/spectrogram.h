@@ -0,0 +1,66 @@
+#pragma once
+#include <SDL.h>
+#include <cstdint>
+#include <functional>
+#include <vector>
+typedef unsigned int uint;
+
+// STFT magnitude image of one signal, drawn from an SDL texture. Columns are
+// computed a batch at a time and stored as 8-bit dB levels in a mip pyramid
+// (level l keeps the max of 2^l columns), so a redraw never uploads more
+// than one texture's worth of pixels, whatever the file length.
+class spectrogram
+{
+public:
+    enum colormap { gray, heat };
+
+    spectrogram(SDL_Renderer *renderer) : renderer(renderer) { build_lut(); }
+    ~spectrogram() { release(); }
+    // Must run before the renderer is destroyed.
+    void release();
+
+    // Fills out with n samples from first, zero past the end.
+    typedef std::function<void(size_t first, size_t n, double *out)> reader;
+
+    void set_source(reader read, size_t num_samples, double rate);
+    // Computes new columns for about budget_ms and queues them for upload.
+    void step(double budget_ms);
+    void draw();
+
+private:
+    static constexpr uint fft_size = 1024;
+    static constexpr uint hop = 512;
+    static constexpr uint bins = fft_size / 2;
+    static constexpr uint tex_width = 1024;
+    // Range stored in the 8-bit levels; the colour range below picks a part of it.
+    static constexpr float store_min_db = -120.f;
+    static constexpr float store_max_db = 0.f;
+
+    SDL_Renderer *renderer;
+    SDL_Texture *texture = nullptr;
+    reader read;
+    size_t num_samples = 0;
+    double rate = 1.0;
+    uint total_columns = 0;
+    // levels[l][c * bins + k]: bin k of column c at level l
+    std::vector<std::vector<uint8_t>> levels;
+    std::vector<double> hann;
+
+    int cmap = heat;
+    float min_db = -90.f;
+    float max_db = 0.f;
+    uint32_t lut[256];
+
+    float view_start = 0.f;
+    float view_end = 0.f;
+    int tex_level = -1;
+    uint tex_first = 0;
+    uint tex_filled = 0;
+    // Part of the texture width the view covers.
+    float tex_span = 1.f;
+
+    uint columns(uint level) const { return levels[level].size() / bins; }
+    void build_lut();
+    void compute(uint first, uint count);
+    void upload(uint end);
+};